@@ -0,0 +1,144 @@
+#include "OverlapAddNoiseSampler.h"
+#include <cmath>
+#include <algorithm>
+
+OverlapAddNoiseSampler::OverlapAddNoiseSampler():
+	_frame_size(0),
+	_channels_count(0),
+	_output_rms(0),
+	_is_primed(false),
+	_hop_size(0),
+	_hop_index(0),
+	_output_index(0),
+	_frame_index(0),
+	_seed(0),
+	_stream(0),
+	_db_per_octave(0)
+{}
+
+void OverlapAddNoiseSampler::set_frame_size(size_t frame_size, size_t hop_size, size_t channels_count, double sample_rate, bool is_reproducible) {
+    _frame_size = frame_size;
+    _channels_count = channels_count;
+    _transform.set_size(frame_size, channels_count, 1, is_reproducible, TransformExecution::whole);
+    _output.resize(frame_size * channels_count);
+    _hop_size = hop_size;
+    _shaper.set_frame_size(frame_size, sample_rate);
+    _output_rms = SpectralNoiseShaper::output_rms(sample_rate);
+
+    // square root of a periodic hann window, scaled so the squared windows of overlapping frames sum to 1
+    // frames are uncorrelated, so this keeps the output power constant across frame boundaries
+    auto const pi = std::acos(-1.0);
+    auto const overlap_gain = 2.0 * hop_size / frame_size;
+    _window.resize(frame_size);
+    for (size_t i = 0; i < frame_size; ++i) {
+        auto const hann = 0.5 - 0.5 * std::cos(2 * pi * i / frame_size);
+        _window[i] = float(std::sqrt(hann * overlap_gain));
+    }
+}
+
+SpectralNoiseTransform& OverlapAddNoiseSampler::transform() {
+    return _transform;
+}
+
+void OverlapAddNoiseSampler::set_seed(uint64_t seed, uint32_t stream) {
+    _seed = seed;
+    _stream = stream;
+}
+
+void OverlapAddNoiseSampler::set_db_per_octave(float db_per_octave) {
+	_db_per_octave = db_per_octave;
+}
+
+// frames are added as soon as their first hop starts playing, so the output is never delayed
+int OverlapAddNoiseSampler::latency_samples() const {
+    return 0;
+}
+
+// the pre-roll is silent if the plan hasn't arrived yet, the frames then fade in as they overlap
+void OverlapAddNoiseSampler::reset() {
+    std::fill(_output.begin(), _output.end(), 0.f);
+    _output_index = 0;
+    _hop_index = _hop_size;
+    _frame_index = 0;
+    _is_primed = _transform.is_planned();
+
+    // pre-roll the frames overlapping the first hop, so playback starts at full level
+    if (_frame_size > _hop_size) {
+        play(nullptr, 0, _frame_size - _hop_size);
+    }
+}
+
+void OverlapAddNoiseSampler::add_next_frame() {
+    if (!_transform.is_planned()) {
+        return;
+    }
+
+    auto const db_per_octave = _db_per_octave.load();
+    for (size_t channel = 0; channel < _channels_count; ++channel) {
+        _shaper.set_seed(_seed, _stream + uint32_t(channel));
+        _shaper.fill(_transform.real(0, channel), _transform.imaginary(0, channel), db_per_octave, _frame_index, _output_rms);
+    }
+    ++_frame_index;
+    // a single execution transforms the frames of every channel
+    _transform.execute(0);
+
+    auto const wrapped_size = _frame_size - _output_index;
+    for (size_t channel = 0; channel < _channels_count; ++channel) {
+        auto const* frame = _transform.samples(0, channel);
+        auto* output = _output.data() + channel * _frame_size;
+        for (size_t i = 0; i < wrapped_size; ++i) {
+            output[_output_index + i] += frame[i] * _window[i];
+        }
+        for (size_t i = wrapped_size; i < _frame_size; ++i) {
+            output[_output_index + i - _frame_size] += frame[i] * _window[i];
+        }
+    }
+}
+
+// copies the accumulators a hop at a time, splitting spans at the hop boundaries and the wrap point
+// the hop being played has received all of its frames, it is cleared for the frame it will carry next
+void OverlapAddNoiseSampler::play(float* const* channels, size_t channels_count, size_t count) {
+    size_t offset = 0;
+    while (offset < count) {
+        if (_hop_index >= _hop_size) {
+            add_next_frame();
+            _hop_index = 0;
+        }
+        auto const span = std::min({count - offset, _hop_size - _hop_index, _frame_size - _output_index});
+        for (size_t channel = 0; channel < _channels_count; ++channel) {
+            auto* output = _output.data() + channel * _frame_size + _output_index;
+            if (channels && channel < channels_count) {
+                std::copy_n(output, span, channels[channel] + offset);
+            }
+            std::fill_n(output, span, 0.f);
+        }
+        _hop_index += span;
+        _output_index += span;
+        if (_output_index >= _frame_size) {
+            _output_index = 0;
+        }
+        offset += span;
+    }
+}
+
+void OverlapAddNoiseSampler::render(float* const* channels, size_t channels_count, size_t count) {
+    auto const rendered_channels_count = _output.empty() ? 0 : std::min(channels_count, _channels_count);
+    for (size_t channel = rendered_channels_count; channel < channels_count; ++channel) {
+        std::fill(channels[channel], channels[channel] + count, 0.f);
+    }
+    if (rendered_channels_count == 0) {
+        return;
+    }
+    _transform.want_plan();
+
+    play(channels, rendered_channels_count, count);
+}
+
+void OverlapAddNoiseSampler::idle() {
+    if (_output.empty() || !_transform.want_plan()) {
+        return;
+    }
+    if (!_is_primed) {
+        reset();
+    }
+}
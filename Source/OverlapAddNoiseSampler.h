@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "SpectralNoiseShaper.h"
+#include "SpectralNoiseTransform.h"
+
+// streams noise as overlapping short windowed frames, one small inverse transform per hop for every channel
+// the frame is the single buffer of the transform, channel c of the output starts at c * frame size
+class OverlapAddNoiseSampler
+{
+	size_t _frame_size;
+	size_t _channels_count;
+	SpectralNoiseTransform _transform;
+	std::vector<float> _window;
+	// circular overlap-add accumulators, one frame long per channel
+	std::vector<float> _output;
+	SpectralNoiseShaper _shaper;
+	float _output_rms;
+	// the pre-roll ran with a plan, a silent one is run again once the plan arrives
+	bool _is_primed;
+
+	size_t _hop_size;
+	size_t _hop_index;
+	size_t _output_index;
+	uint64_t _frame_index;
+	uint64_t _seed;
+	// channels draw consecutive streams from this one
+	uint32_t _stream;
+	std::atomic<float> _db_per_octave;
+
+	void add_next_frame();
+	// null channels only advance the playback
+	void play(float* const* channels, size_t channels_count, size_t count);
+
+public:
+	OverlapAddNoiseSampler();
+	// frame_size must be a multiple of hop_size, at least twice as large, reset() before rendering
+	void set_frame_size(size_t frame_size, size_t hop_size, size_t channels_count, double sample_rate, bool is_reproducible);
+	// frames are silent until the plan arrives
+	SpectralNoiseTransform& transform();
+	void set_seed(uint64_t seed, uint32_t stream);
+	void set_db_per_octave(float db_per_octave);
+	int latency_samples() const;
+	void reset();
+	// channels past the sampler's own are cleared
+	void render(float* const* channels, size_t channels_count, size_t count);
+	// called instead of render while the output is silent, no frames are added
+	// only asks for the plan and pre-rolls with it, so the next note starts at full level
+	void idle();
+};
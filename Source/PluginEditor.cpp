@@ -8,6 +8,14 @@ SpectralNoiseAudioProcessorEditor::SpectralNoiseAudioProcessorEditor(SpectralNoi
 {
     for (auto const& parameter_id : {
         SpectralNoiseAudioProcessor::TILT_ID,
+        SpectralNoiseAudioProcessor::SEED_ID,
+        SpectralNoiseAudioProcessor::UNISON_ID,
+        SpectralNoiseAudioProcessor::DETUNE_ID,
+        SpectralNoiseAudioProcessor::ATTACK_ID,
+        SpectralNoiseAudioProcessor::DECAY_ID,
+        SpectralNoiseAudioProcessor::SUSTAIN_ID,
+        SpectralNoiseAudioProcessor::RELEASE_ID,
+        SpectralNoiseAudioProcessor::EXPRESSION_TILT_ID,
     }) {
         _slider_packs.emplace_back(
             std::make_unique<SliderPack>(
@@ -27,6 +35,20 @@ SpectralNoiseAudioProcessorEditor::SpectralNoiseAudioProcessorEditor(SpectralNoi
                 static_cast<unsigned int>(_button_packs.size())));
     }
 
+    // combo boxes share the left column with the buttons, below them
+    for (auto const& parameter_id: {
+        SpectralNoiseAudioProcessor::REGENERATION_ID,
+        SpectralNoiseAudioProcessor::ENGINE_ID,
+        SpectralNoiseAudioProcessor::EXPRESSION_ID,
+    }) {
+        _choice_packs.emplace_back(
+            std::make_unique<ChoicePack>(
+                *this,
+                value_tree_state,
+                parameter_id,
+                static_cast<unsigned int>(_button_packs.size() + _choice_packs.size())));
+    }
+
     setResizable(false, false);
     setSize(static_cast<unsigned int>((_slider_packs.size() + 1) * 100), 140);
 }
@@ -67,6 +89,19 @@ SpectralNoiseAudioProcessorEditor::ButtonPack::ButtonPack(
     editor.addAndMakeVisible(_button);
 }
 
+SpectralNoiseAudioProcessorEditor::ChoicePack::ChoicePack(
+    SpectralNoiseAudioProcessorEditor& editor,
+    juce::AudioProcessorValueTreeState& value_tree_state,
+    juce::StringRef const parameter_identifier,
+    unsigned int combo_box_position
+) {
+    auto const& parameter = value_tree_state.getParameter(parameter_identifier);
+    _combo_box.addItemList(parameter->getAllValueStrings(), 1);
+    _attachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(value_tree_state, parameter_identifier, _combo_box);
+    _combo_box.setBounds(0, 25 * combo_box_position, 105, 25);
+    editor.addAndMakeVisible(_combo_box);
+}
+
 SpectralNoiseAudioProcessorEditor::~SpectralNoiseAudioProcessorEditor() {
 }
 
@@ -35,8 +35,24 @@ class SpectralNoiseAudioProcessorEditor  : public juce::AudioProcessorEditor {
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ButtonPack)
     };
 
+    class ChoicePack {
+        juce::ComboBox _combo_box;
+        // created once the items are in, so the attachment can select the current choice
+        std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> _attachment;
+
+    public:
+        ChoicePack(
+            SpectralNoiseAudioProcessorEditor& editor,
+            juce::AudioProcessorValueTreeState& value_tree_state,
+            juce::StringRef const parameter_identifier,
+            unsigned int combo_box_position);
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ChoicePack)
+    };
+
     std::vector<std::unique_ptr<SliderPack>> _slider_packs;
     std::vector<std::unique_ptr<ButtonPack>> _button_packs;
+    std::vector<std::unique_ptr<ChoicePack>> _choice_packs;
 
 public:
     SpectralNoiseAudioProcessorEditor(SpectralNoiseAudioProcessor&, juce::AudioProcessorValueTreeState&);
@@ -1,14 +1,25 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 #include <cmath>
-#include <random>
 #include <functional>
 #include <cstdlib>
 #include "fftw-3.3/api/fftw3.h"
+#include "SpectralNoisePlanner.h"
 
 #define M_PI 3.1415926535897932384626433832795028841971693993751058209
 
 juce::String const SpectralNoiseAudioProcessor::TILT_ID = "tilt";
+juce::String const SpectralNoiseAudioProcessor::REGENERATION_ID = "regeneration";
+juce::String const SpectralNoiseAudioProcessor::ENGINE_ID = "engine";
+juce::String const SpectralNoiseAudioProcessor::SEED_ID = "seed";
+juce::String const SpectralNoiseAudioProcessor::UNISON_ID = "unison";
+juce::String const SpectralNoiseAudioProcessor::DETUNE_ID = "detune";
+juce::String const SpectralNoiseAudioProcessor::ATTACK_ID = "attack";
+juce::String const SpectralNoiseAudioProcessor::DECAY_ID = "decay";
+juce::String const SpectralNoiseAudioProcessor::SUSTAIN_ID = "sustain";
+juce::String const SpectralNoiseAudioProcessor::RELEASE_ID = "release";
+juce::String const SpectralNoiseAudioProcessor::EXPRESSION_ID = "expression";
+juce::String const SpectralNoiseAudioProcessor::EXPRESSION_TILT_ID = "expression_tilt";
 
 SpectralNoiseAudioProcessor::SpectralNoiseAudioProcessor():
     #ifndef JucePlugin_PreferredChannelConfigurations
@@ -21,6 +32,10 @@ SpectralNoiseAudioProcessor::SpectralNoiseAudioProcessor():
             #endif
         ),
     #endif
+    _active_engine(NoiseEngine::single_frame),
+    _notes_count(0),
+    _envelope_shape(SpectralNoiseEnvelope::Shape::from_times(0, 0, 1, 0, 44100)),
+    _sample_rate(44100),
     _value_tree_state {
         *this, nullptr, "PARAMETERS", {
             std::make_unique<juce::AudioParameterFloat>(
@@ -28,15 +43,114 @@ SpectralNoiseAudioProcessor::SpectralNoiseAudioProcessor():
                 "Tilt",
                 juce::NormalisableRange<float>(-12.f, 12.f, 0.0001f),
                 -6.f),
+            std::make_unique<juce::AudioParameterChoice>(
+                REGENERATION_ID,
+                "Regeneration",
+                juce::StringArray { "Inline regen", "Background regen", "Amortized regen" },
+                int(RegenerationMode::synchronous)),
+            std::make_unique<juce::AudioParameterChoice>(
+                ENGINE_ID,
+                "Engine",
+                juce::StringArray { "Single frame", "Overlap-add", "Pitched voices" },
+                int(NoiseEngine::single_frame)),
+            std::make_unique<juce::AudioParameterInt>(
+                SEED_ID,
+                "Seed",
+                0,
+                999999,
+                0),
+            std::make_unique<juce::AudioParameterInt>(
+                UNISON_ID,
+                "Unison",
+                1,
+                int(SpectralNoiseVoices::max_unison),
+                1),
+            std::make_unique<juce::AudioParameterFloat>(
+                DETUNE_ID,
+                "Detune",
+                juce::NormalisableRange<float>(0.f, 100.f, 0.01f),
+                20.f),
+            // times in milliseconds, the envelopes ramp over at least one
+            std::make_unique<juce::AudioParameterFloat>(
+                ATTACK_ID,
+                "Attack",
+                juce::NormalisableRange<float>(1.f, 5000.f, 0.01f, 0.3f),
+                5.f),
+            std::make_unique<juce::AudioParameterFloat>(
+                DECAY_ID,
+                "Decay",
+                juce::NormalisableRange<float>(1.f, 5000.f, 0.01f, 0.3f),
+                300.f),
+            std::make_unique<juce::AudioParameterFloat>(
+                SUSTAIN_ID,
+                "Sustain",
+                juce::NormalisableRange<float>(0.f, 1.f, 0.0001f),
+                1.f),
+            std::make_unique<juce::AudioParameterFloat>(
+                RELEASE_ID,
+                "Release",
+                juce::NormalisableRange<float>(1.f, 5000.f, 0.01f, 0.3f),
+                50.f),
+            std::make_unique<juce::AudioParameterChoice>(
+                EXPRESSION_ID,
+                "Expression",
+                juce::StringArray { "Pressure", "Slide" },
+                int(ExpressionSource::pressure)),
+            // added to the tilt of a pitched voice at full expression
+            std::make_unique<juce::AudioParameterFloat>(
+                EXPRESSION_TILT_ID,
+                "Expression tilt",
+                juce::NormalisableRange<float>(-24.f, 24.f, 0.0001f),
+                6.f),
         }
     },
-    _tilt(_value_tree_state.getRawParameterValue(TILT_ID))
+    _tilt(_value_tree_state.getRawParameterValue(TILT_ID)),
+    _regeneration(_value_tree_state.getRawParameterValue(REGENERATION_ID)),
+    _engine(_value_tree_state.getRawParameterValue(ENGINE_ID)),
+    _seed(_value_tree_state.getRawParameterValue(SEED_ID)),
+    _unison(_value_tree_state.getRawParameterValue(UNISON_ID)),
+    _detune(_value_tree_state.getRawParameterValue(DETUNE_ID)),
+    _attack(_value_tree_state.getRawParameterValue(ATTACK_ID)),
+    _decay(_value_tree_state.getRawParameterValue(DECAY_ID)),
+    _sustain(_value_tree_state.getRawParameterValue(SUSTAIN_ID)),
+    _release(_value_tree_state.getRawParameterValue(RELEASE_ID)),
+    _expression(_value_tree_state.getRawParameterValue(EXPRESSION_ID)),
+    _expression_tilt(_value_tree_state.getRawParameterValue(EXPRESSION_TILT_ID)),
+    _has_worker(false),
+    _is_planner_started(false)
 {
     _value_tree_state.getParameter(TILT_ID)->addListener(this);
 }
 
-SpectralNoiseAudioProcessor::~SpectralNoiseAudioProcessor()
-{}
+SpectralNoiseAudioProcessor::~SpectralNoiseAudioProcessor() {
+    _worker.stop();
+    cancelPendingUpdate();
+    stop_planner();
+}
+
+// instances that are only constructed, by plugin scans, never start the planning thread or read the wisdom
+void SpectralNoiseAudioProcessor::start_planner() {
+    if (_is_planner_started) {
+        return;
+    }
+    _is_planner_started = true;
+
+    // plans measured in earlier sessions, shared by every instance of the plugin
+    auto const wisdom_file = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile(JucePlugin_Name)
+        .getChildFile("fftwf.wisdom");
+    wisdom_file.getParentDirectory().createDirectory();
+    SpectralNoisePlanner::start(wisdom_file.getFullPathName().toStdString());
+}
+
+// the thread keeps running while other instances use it
+void SpectralNoiseAudioProcessor::stop_planner() {
+    if (!_is_planner_started) {
+        return;
+    }
+    _is_planner_started = false;
+    SpectralNoisePlanner::stop();
+}
 
 const juce::String SpectralNoiseAudioProcessor::getName() const {
     return JucePlugin_Name;
@@ -74,15 +188,104 @@ const juce::String SpectralNoiseAudioProcessor::getProgramName(int index) {
 
 void SpectralNoiseAudioProcessor::changeProgramName(int index, const juce::String& new_name) {}
 
+// a given seed, tilt and sample rate render the same samples every time, offline renders stick to that
+// background buffers need the worker, playback prepared without it amortizes them instead
+RegenerationMode SpectralNoiseAudioProcessor::regeneration_mode() const {
+    if (isNonRealtime()) {
+        return RegenerationMode::synchronous;
+    }
+    auto const regeneration_mode = RegenerationMode(int(_regeneration->load()));
+    if (regeneration_mode == RegenerationMode::background && !_has_worker) {
+        return RegenerationMode::amortized;
+    }
+    return regeneration_mode;
+}
+
+void SpectralNoiseAudioProcessor::set_seed() {
+    auto const seed = uint64_t(_seed->load());
+    _noise_sampler.set_seed(seed, 0);
+    _overlap_add_sampler.set_seed(seed, 0);
+    _colours.set_seed(seed, 0);
+}
+
 void SpectralNoiseAudioProcessor::prepareToPlay(double sample_rate, int samples_per_block) {
-    for (auto& noise_sampler : _noise_samplers) {
-        noise_sampler.set_buffer_size(std::ceil(sample_rate));
-        noise_sampler.set_db_per_octave(_tilt->load());
-        noise_sampler.resample_noise();
+    _worker.stop();
+    cancelPendingUpdate();
+    _has_worker = isNonRealtime() || RegenerationMode(int(_regeneration->load())) != RegenerationMode::amortized;
+    if (_has_worker) {
+        start_planner();
     }
+    else {
+        stop_planner();
+    }
+    auto const output_channels = size_t(getTotalNumOutputChannels());
+    _span_channels.resize(output_channels);
+    _notes_count = 0;
+    _gate.reset();
+    _voices.reset();
+    _active_engine = NoiseEngine(int(_engine->load()));
+    _gate_gains.resize(SpectralNoiseVoices::chunk_size);
+    _sample_rate = sample_rate;
+    set_seed();
+
+    // the worker requests the plans once the samplers first render, and the planning thread delivers them
+    // frames of about a second, at a size fftw transforms quickly rather than exactly the sample rate
+    // every channel is regenerated by the same transform
+    auto const frame_size = SpectralNoisePlanner::frame_size(sample_rate, 1.0, FrameSizePolicy::fast);
+    _noise_sampler.set_buffer_size(frame_size, output_channels, sample_rate, isNonRealtime());
+    _noise_sampler.set_db_per_octave(_tilt->load());
+    _noise_sampler.set_regeneration_mode(regeneration_mode());
+    _colours.set_amortized(regeneration_mode() != RegenerationMode::synchronous);
+    // the voices' colours are one period of their lowest note, the size also halves down to every level of their tables
+    auto const colours_frame_size = SpectralNoisePlanner::frame_size(sample_rate, SpectralNoiseVoices::frame_duration(), FrameSizePolicy::fast, SpectralNoiseTables::levels_count - 1);
+    _colours.prepare(colours_frame_size, output_channels, sample_rate, isNonRealtime());
+    // the other engines never allocate them, offline renders need them for the first note
+    if (isNonRealtime() || _active_engine == NoiseEngine::pitched_voices) {
+        _colours.allocate();
+    }
+    _voices.prepare(voices_count, _colours.frame_size(), sample_rate);
+
+    // frames just long enough to resolve the high-pass corner, powers of two split into whole hops
+    auto const overlap_add_frame_size = SpectralNoisePlanner::frame_size(sample_rate, SpectralNoiseShaper::min_frame_duration(), FrameSizePolicy::power_of_two);
+    auto const overlap_add_hop_size = overlap_add_frame_size / 4;
+    _overlap_add_sampler.set_db_per_octave(_tilt->load());
+    _overlap_add_sampler.set_frame_size(overlap_add_frame_size, overlap_add_hop_size, output_channels, sample_rate, isNonRealtime());
+
+    // offline renders need their plans for the first block, realtime playback stays silent until the worker gets them
+    // without the worker every plan is made here, on this thread unless another instance runs the planning thread
+    // nothing upgrades those, they stay estimated
+    if (!_has_worker || isNonRealtime()) {
+        _noise_sampler.transform().request_plan();
+        _overlap_add_sampler.transform().request_plan();
+        if (_colours.is_allocated()) {
+            _colours.transform().request_plan();
+        }
+        SpectralNoisePlanner::wait_for_requests();
+    }
+
+    _noise_sampler.resample_noise();
+    _overlap_add_sampler.reset();
+
+    if (_has_worker) {
+        _worker.start({ &_noise_sampler }, { &_noise_sampler.transform(), &_overlap_add_sampler.transform(), &_colours.transform() }, { &_colours });
+    }
+
+    auto const engine = NoiseEngine(int(_engine->load()));
+    setLatencySamples(engine == NoiseEngine::overlap_add ? _overlap_add_sampler.latency_samples() : 0);
 }
 
-void SpectralNoiseAudioProcessor::releaseResources() {}
+void SpectralNoiseAudioProcessor::releaseResources() {
+    _worker.stop();
+    cancelPendingUpdate();
+}
+
+// without the worker the colours switched to after prepareToPlay are allocated and planned here, on the message thread
+void SpectralNoiseAudioProcessor::handleAsyncUpdate() {
+    if (_colours.is_allocation_wanted()) {
+        _colours.allocate();
+        _colours.transform().request_plan();
+    }
+}
 
 #ifndef JucePlugin_PreferredChannelConfigurations
 bool SpectralNoiseAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const {
@@ -90,9 +293,8 @@ bool SpectralNoiseAudioProcessor::isBusesLayoutSupported(const BusesLayout& layo
         juce::ignoreUnused (layouts);
         return true;
     #else
-        if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono() &&
-            layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo()
-        ) {
+        // every channel gets its own decorrelated noise, any layout works, surround and ambisonic ones included
+        if (layouts.getMainOutputChannelSet().isDisabled()) {
             return false;
         }
         #if ! JucePlugin_IsSynth
@@ -118,38 +320,172 @@ static juce::MidiBuffer filterMidiMessagesForChannel(const juce::MidiBuffer& inp
     return output;
 }
 
+// renders every output channel between two events, notes only start and stop at the span boundaries
+// spans the gate has closed are cleared without rendering, the noise resumes where it stopped on the next note
+void SpectralNoiseAudioProcessor::render_span(juce::AudioBuffer<float>& buffer, NoiseEngine engine, int begin, int end) {
+    auto const count = end - begin;
+    if (count <= 0) {
+        return;
+    }
+
+    auto const output_channels = _span_channels.size();
+    for (size_t channel = 0; channel < output_channels; ++channel) {
+        _span_channels[channel] = buffer.getWritePointer(int(channel), begin);
+    }
+
+    // the voices apply their own envelopes
+    if (engine == NoiseEngine::pitched_voices) {
+        _voices.render(_colours, _span_channels.data(), output_channels, size_t(count));
+        return;
+    }
+
+    if (!_gate.is_active()) {
+        for (size_t channel = 0; channel < output_channels; ++channel) {
+            buffer.clear(int(channel), begin, count);
+        }
+        return;
+    }
+
+    if (engine == NoiseEngine::overlap_add) {
+        _overlap_add_sampler.render(_span_channels.data(), output_channels, size_t(count));
+    }
+    else {
+        _noise_sampler.render(_span_channels.data(), output_channels, size_t(count));
+    }
+    apply_gate(begin, count);
+}
+
+// the gains are rendered once per chunk, as ramps, and multiplied into every channel
+void SpectralNoiseAudioProcessor::apply_gate(int begin, int count) {
+    auto const chunk_size = int(_gate_gains.size());
+    for (int chunk_begin = 0; chunk_begin < count; chunk_begin += chunk_size) {
+        auto const chunk = std::min(chunk_size, count - chunk_begin);
+        _gate.render(_envelope_shape, _gate_gains.data(), size_t(chunk));
+        for (auto* channel : _span_channels) {
+            juce::FloatVectorOperations::multiply(channel + chunk_begin, _gate_gains.data(), chunk);
+        }
+    }
+}
+
+// each envelope only advances while its engine renders, one left sounding in the other engine would never end
+// notes held across the change are dropped, the new engine starts silent
+void SpectralNoiseAudioProcessor::set_active_engine(NoiseEngine engine) {
+    if (engine == _active_engine) {
+        return;
+    }
+    _active_engine = engine;
+    _notes_count = 0;
+    _gate.reset();
+    _voices.reset();
+}
+
+// the pitched voices take the notes and their expression, the other engines share the gate
+// every note retriggers the gate from its current level, it is released with the last note
+void SpectralNoiseAudioProcessor::handle_midi_message(juce::MidiMessage const& message, NoiseEngine engine) {
+    auto const is_pitched = engine == NoiseEngine::pitched_voices;
+    if (message.isNoteOn()) {
+        ++_notes_count;
+        if (is_pitched) {
+            _voices.note_on(message.getChannel(), message.getNoteNumber(), message.getFloatVelocity());
+        }
+        else {
+            _gate.note_on(message.getFloatVelocity());
+        }
+    }
+    else if (message.isNoteOff()) {
+        if (_notes_count > 0) {
+            --_notes_count;
+        }
+        if (is_pitched) {
+            _voices.note_off(message.getChannel(), message.getNoteNumber());
+        }
+        else if (_notes_count == 0) {
+            _gate.note_off(_envelope_shape);
+        }
+    }
+    else if (message.isAllNotesOff() || message.isAllSoundOff()) {
+        _notes_count = 0;
+        if (is_pitched) {
+            _voices.all_notes_off();
+        }
+        else {
+            _gate.note_off(_envelope_shape);
+        }
+    }
+    else if (!is_pitched) {
+        return;
+    }
+    else if (ExpressionSource(int(_expression->load())) == ExpressionSource::pressure) {
+        if (message.isChannelPressure()) {
+            _voices.set_channel_expression(message.getChannel(), message.getChannelPressureValue() / 127.f);
+        }
+        else if (message.isAftertouch()) {
+            _voices.set_note_expression(message.getChannel(), message.getNoteNumber(), message.getAfterTouchValue() / 127.f);
+        }
+    }
+    else if (message.isControllerOfType(74)) {
+        _voices.set_channel_expression(message.getChannel(), message.getControllerValue() / 127.f);
+    }
+}
+
 void SpectralNoiseAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi_messages) {
     juce::ScopedNoDenormals noDenormals;
-    auto const input_channels = getTotalNumInputChannels();
-    auto const output_channels = getTotalNumOutputChannels();
-    auto const num_channels = std::max(input_channels, output_channels);
     auto const num_samples = buffer.getNumSamples();
 
-    _notes_counts.resize(output_channels, 0);
+    _span_channels.resize(size_t(getTotalNumOutputChannels()));
 
-    for (size_t channel = 0; channel < output_channels; ++channel) {
-        auto* channel_data = buffer.getWritePointer(channel);
-        size_t& notes_count = _notes_counts[channel];
-
-        for (size_t i = 0; i < num_samples; ++i) {
-            for (auto metadata : midi_messages) {
-                auto message = metadata.getMessage();
-                if (size_t(message.getTimeStamp()) == i) {
-                    if (message.isNoteOn()) {
-                        ++notes_count;
-                    }
-                    if (message.isNoteOff()) {
-                        --notes_count;
-                    }
-                }
-            }
-            float weight = float(bool(notes_count));
-            // adjust _buffer_size to play tones
-            // use multiple voices with slightly different pitches for unison
-            // use many _buffer_indices for stereo width
-            channel_data[i] = _noise_samplers[channel].next_sample() * weight;
+    auto const engine = NoiseEngine(int(_engine->load()));
+    set_active_engine(engine);
+    _noise_sampler.set_regeneration_mode(regeneration_mode());
+    _colours.set_amortized(regeneration_mode() != RegenerationMode::synchronous);
+    set_seed();
+    _voices.set_unison(size_t(_unison->load()), _detune->load());
+    _envelope_shape = SpectralNoiseEnvelope::Shape::from_times(
+        _attack->load() / 1000.0,
+        _decay->load() / 1000.0,
+        _sustain->load(),
+        _release->load() / 1000.0,
+        _sample_rate);
+    _voices.set_envelope(_envelope_shape);
+    _voices.set_tilt(_tilt->load(), _expression_tilt->load());
+    // the worker allocates the colours the last refresh asked for, without it the message thread does
+    if (engine == NoiseEngine::pitched_voices && !_has_worker && _colours.is_allocation_wanted()) {
+        triggerAsyncUpdate();
+    }
+
+    // silent blocks only keep the active engine ready for the next note, once its release has ended
+    auto const is_sounding = engine == NoiseEngine::pitched_voices ? _voices.is_active() : _gate.is_active();
+    if (!is_sounding && midi_messages.isEmpty()) {
+        buffer.clear();
+        if (engine == NoiseEngine::overlap_add) {
+            _overlap_add_sampler.idle();
+        }
+        else if (engine == NoiseEngine::pitched_voices) {
+            _colours.refresh(size_t(num_samples));
         }
+        else {
+            _noise_sampler.idle(size_t(num_samples));
+        }
+        return;
+    }
+
+    if (engine == NoiseEngine::single_frame) {
+        _noise_sampler.advance_next_buffer(num_samples);
+    }
+    // the voices keep their own positions and colours, the cache is only rebuilt after a seed change
+    else if (engine == NoiseEngine::pitched_voices) {
+        _colours.refresh(size_t(num_samples));
     }
+
+    // the events are walked once, in order, rendering the span up to each one before it is applied
+    int position = 0;
+    for (auto const metadata : midi_messages) {
+        auto const event_position = juce::jlimit(position, num_samples, metadata.samplePosition);
+        render_span(buffer, engine, position, event_position);
+        position = event_position;
+        handle_midi_message(metadata.getMessage(), engine);
+    }
+    render_span(buffer, engine, position, num_samples);
 }
 
 bool SpectralNoiseAudioProcessor::hasEditor() const {
@@ -174,10 +510,9 @@ void SpectralNoiseAudioProcessor::setStateInformation(const void* data, int size
 }
 
 void SpectralNoiseAudioProcessor::parameterValueChanged(int parameter_id, float value) {
-    for (auto& noise_sampler : _noise_samplers) {
-        noise_sampler.set_db_per_octave(_tilt->load());
-        noise_sampler.resample_noise();
-    }
+    // the samplers pick up the new tilt on their next sample, this can be called from any thread
+    _noise_sampler.set_db_per_octave(_tilt->load());
+    _overlap_add_sampler.set_db_per_octave(_tilt->load());
 }
 
 void SpectralNoiseAudioProcessor::parameterGestureChanged(int parameter_id, bool gesture_is_starting) {
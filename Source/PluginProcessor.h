@@ -2,16 +2,78 @@
 
 #include <JuceHeader.h>
 #include "SpectralNoiseSampler.h"
+#include "SpectralNoiseWorker.h"
+#include "OverlapAddNoiseSampler.h"
+#include "SpectralNoiseVoices.h"
 
-class SpectralNoiseAudioProcessor  : public juce::AudioProcessor, public juce::AudioProcessorParameter::Listener {
-    std::array<SpectralNoiseSampler, 2> _noise_samplers;
-    std::vector<size_t> _notes_counts;
+enum class NoiseEngine {
+    single_frame,
+    overlap_add,
+    // notes play the single frame at pitched rates
+    pitched_voices,
+};
+
+// the per note control that tilts a pitched voice, mpe controllers send both on each note's own channel
+enum class ExpressionSource {
+    // channel pressure, or polyphonic aftertouch from controllers without mpe
+    pressure,
+    // controller 74
+    slide,
+};
+
+class SpectralNoiseAudioProcessor  : public juce::AudioProcessor, public juce::AudioProcessorParameter::Listener, private juce::AsyncUpdater {
+    SpectralNoiseSampler _noise_sampler;
+    OverlapAddNoiseSampler _overlap_add_sampler;
+    SpectralNoiseVoices _voices;
+    // the voices read the frame at every colour, regenerated only when the seed changes
+    // allocated when the voices first play, by the worker or an async update without it
+    SpectralNoiseColours _colours;
+    // notes only reach the engine playing when they arrive, the other one is silenced when the engine changes
+    NoiseEngine _active_engine;
+    // held notes gate the output of the unpitched engines through one envelope, updated only at the events between the rendered spans
+    size_t _notes_count;
+    SpectralNoiseEnvelope _gate;
+    // a chunk of gains of the gate, rendered before they are applied to every channel
+    std::vector<float> _gate_gains;
+    SpectralNoiseEnvelope::Shape _envelope_shape;
+    double _sample_rate;
+    // the output channels offset to the start of the span being rendered
+    std::vector<float*> _span_channels;
+    SpectralNoiseWorker _worker;
+    // playback prepared in amortized mode runs without the worker or the planning thread
+    bool _has_worker;
 
     juce::AudioProcessorValueTreeState _value_tree_state;
     std::atomic<float>* _tilt;
+    std::atomic<float>* _regeneration;
+    std::atomic<float>* _engine;
+    // every channel draws its own stream of the sequence this seed selects
+    std::atomic<float>* _seed;
+    std::atomic<float>* _unison;
+    std::atomic<float>* _detune;
+    std::atomic<float>* _attack;
+    std::atomic<float>* _decay;
+    std::atomic<float>* _sustain;
+    std::atomic<float>* _release;
+    std::atomic<float>* _expression;
+    std::atomic<float>* _expression_tilt;
+    bool _is_planner_started;
 
 public:
+    static constexpr size_t voices_count = 16;
+
     static juce::String const TILT_ID;
+    static juce::String const REGENERATION_ID;
+    static juce::String const ENGINE_ID;
+    static juce::String const SEED_ID;
+    static juce::String const UNISON_ID;
+    static juce::String const DETUNE_ID;
+    static juce::String const ATTACK_ID;
+    static juce::String const DECAY_ID;
+    static juce::String const SUSTAIN_ID;
+    static juce::String const RELEASE_ID;
+    static juce::String const EXPRESSION_ID;
+    static juce::String const EXPRESSION_TILT_ID;
 
     SpectralNoiseAudioProcessor();
     ~SpectralNoiseAudioProcessor() override;
@@ -47,5 +109,15 @@ public:
     void parameterGestureChanged(int, bool) override;
 
 private:
+    void start_planner();
+    void stop_planner();
+    RegenerationMode regeneration_mode() const;
+    void set_seed();
+    void render_span(juce::AudioBuffer<float>& buffer, NoiseEngine engine, int begin, int end);
+    void set_active_engine(NoiseEngine engine);
+    void handle_midi_message(juce::MidiMessage const& message, NoiseEngine engine);
+    void apply_gate(int begin, int count);
+    void handleAsyncUpdate() override;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectralNoiseAudioProcessor)
 };
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <new>
+#include <vector>
+#include <cstddef>
+#include "fftw-3.3/api/fftw3.h"
+
+// allocates through fftw, so arrays start at the alignment of its simd codelets
+template <typename T>
+class SpectralNoiseAllocator
+{
+public:
+	using value_type = T;
+
+	SpectralNoiseAllocator() = default;
+	template <typename U>
+	SpectralNoiseAllocator(SpectralNoiseAllocator<U> const&) {}
+
+	T* allocate(size_t count) {
+		auto* const values = static_cast<T*>(fftwf_malloc(count * sizeof(T)));
+		if (!values && count > 0) {
+			throw std::bad_alloc();
+		}
+		return values;
+	}
+
+	void deallocate(T* values, size_t) {
+		fftwf_free(values);
+	}
+
+	template <typename U>
+	bool operator==(SpectralNoiseAllocator<U> const&) const {
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(SpectralNoiseAllocator<U> const&) const {
+		return false;
+	}
+};
+
+using AlignedFloats = std::vector<float, SpectralNoiseAllocator<float>>;
@@ -0,0 +1,276 @@
+#include "SpectralNoiseColours.h"
+#include <limits>
+#include <algorithm>
+
+SpectralNoiseColours::SpectralNoiseColours():
+	_frame_size(0),
+	_channels_count(0),
+	_is_reproducible(false),
+	_is_allocated(false),
+	_is_allocation_wanted(false),
+	_output_rms(0),
+	_playing_tables(0),
+	_is_current(false),
+	_seed(0),
+	_stream(0),
+	_is_amortized(false),
+	_is_building(false),
+	_build_stage(stage_randomize),
+	_build_step(0),
+	_build_position(0),
+	_build_energy(0),
+	_build_seed(0),
+	_build_stream(0),
+	_build_work(0),
+	_build_samples(1)
+{}
+
+void SpectralNoiseColours::prepare(size_t frame_size, size_t channels_count, double sample_rate, bool is_reproducible) {
+    _frame_size = frame_size;
+    _channels_count = channels_count;
+    _is_reproducible = is_reproducible;
+    _build_samples = std::max(size_t(sample_rate / 2), size_t(1));
+    _is_allocated = false;
+    _is_allocation_wanted = false;
+    _transform.set_size(0, 0, 0, is_reproducible, TransformExecution::stepped);
+    _shapers = std::vector<SpectralNoiseShaper>();
+    _tables = std::vector<SpectralNoiseTables>();
+    _output_rms = SpectralNoiseShaper::output_rms(sample_rate);
+    _playing_tables = 0;
+    _is_current = false;
+    _is_building = false;
+}
+
+// the builds are reset by prepare, the audio thread leaves the frames and tables alone until the flag is set
+void SpectralNoiseColours::allocate() {
+    if (_is_allocated.load() || _frame_size == 0) {
+        return;
+    }
+    auto const frames_count = colours_count * _channels_count;
+    _transform.set_size(_frame_size, 1, frames_count, _is_reproducible, TransformExecution::stepped);
+    _shapers.resize(colours_count);
+    // a frame is one period of the voices' tone, its bins are harmonics rather than frequencies of the output
+    // they are mapped from the pivot up, the tilt is per octave of harmonics and the high-pass only removes dc
+    for (auto& shaper : _shapers) {
+        shaper.set_frame_size(_frame_size, double(_frame_size) * SpectralNoiseShaper::pivot_frequency);
+    }
+    _tables.resize(2 * colours_count);
+    for (auto& tables : _tables) {
+        tables.prepare(_frame_size, _channels_count);
+    }
+
+    size_t tables_size = 0;
+    for (size_t level = 0; level < SpectralNoiseTables::levels_count; ++level) {
+        tables_size += _frame_size >> level;
+    }
+    auto const bins_count = _shapers[0].bins_count();
+    _build_work = (_channels_count + colours_count) * bins_count + frames_count * (3 * bins_count + tables_size + _transform.steps_work());
+    _is_allocated.store(true, std::memory_order_release);
+}
+
+bool SpectralNoiseColours::is_allocated() const {
+    return _is_allocated.load(std::memory_order_acquire);
+}
+
+bool SpectralNoiseColours::is_allocation_wanted() const {
+    return _is_allocation_wanted.load() && !_is_allocated.load();
+}
+
+size_t SpectralNoiseColours::frame_size() const {
+    return _frame_size;
+}
+
+size_t SpectralNoiseColours::channels_count() const {
+    return _channels_count;
+}
+
+SpectralNoiseTransform& SpectralNoiseColours::transform() {
+    return _transform;
+}
+
+void SpectralNoiseColours::set_seed(uint64_t seed, uint32_t stream) {
+    if (_seed == seed && _stream == stream) {
+        return;
+    }
+    _seed = seed;
+    _stream = stream;
+    _is_current = false;
+}
+
+void SpectralNoiseColours::set_amortized(bool is_amortized) {
+    _is_amortized = is_amortized;
+}
+
+// the rate is set so that a build is complete within _build_samples
+// a seed change during a build starts it over, the playing tables stay until one completes
+void SpectralNoiseColours::refresh(size_t samples) {
+    if (!is_allocated()) {
+        _is_allocation_wanted.store(true, std::memory_order_relaxed);
+        return;
+    }
+    if (_transform.is_empty() || _is_current || !_transform.want_plan()) {
+        return;
+    }
+    if (!_is_building || _build_seed != _seed || _build_stream != _stream) {
+        start_build();
+    }
+
+    auto const budget = _is_amortized ? (_build_work * samples + _build_samples - 1) / _build_samples : std::numeric_limits<size_t>::max();
+    size_t work = 0;
+    while (_is_building && work < budget) {
+        work += build_step(budget - work);
+    }
+}
+
+void SpectralNoiseColours::start_build() {
+    _is_building = true;
+    _build_stage = stage_randomize;
+    _build_step = 0;
+    _build_position = 0;
+    _build_seed = _seed;
+    _build_stream = _stream;
+}
+
+// runs a slice of the build, returns its work, every stage is split to the budget
+// the first colour draws the random spectrum of every channel, the others copy it before it is tilted
+// each colour is normalized to the engines' level on its own
+size_t SpectralNoiseColours::build_step(size_t budget) {
+    auto const bins_count = _shapers[0].bins_count();
+    auto const frames_count = colours_count * _channels_count;
+    auto const begin = _build_position;
+    auto const end = begin + std::min(bins_count - begin, budget);
+    switch (_build_stage) {
+        case stage_randomize: {
+            auto const channel = _build_step;
+            _shapers[0].set_seed(_build_seed, _build_stream + uint32_t(channel));
+            _shapers[0].randomize(_transform.real(channel, 0), _transform.imaginary(channel, 0), begin, end, 0);
+            _build_position = end;
+            if (end == bins_count) {
+                next_build_step(_channels_count, stage_gains);
+            }
+            return end - begin;
+        }
+        case stage_gains: {
+            // each colour's table is only built once, its tilt never changes
+            auto const colour = _build_step;
+            auto const db_per_octave = min_db_per_octave + float(colour) * db_per_octave_step;
+            if (_shapers[colour].are_gains_valid(db_per_octave)) {
+                next_build_step(colours_count, stage_copy);
+                return 0;
+            }
+            _shapers[colour].build_gains(db_per_octave, begin, end);
+            _build_position = end;
+            if (end == bins_count) {
+                next_build_step(colours_count, stage_copy);
+            }
+            return end - begin;
+        }
+        case stage_copy: {
+            auto const frame = tilt_frame();
+            auto const channel = frame % _channels_count;
+            if (frame == channel) {
+                _build_stage = stage_measure;
+                _build_energy = 0;
+                return 0;
+            }
+            std::copy(_transform.real(channel, 0) + begin, _transform.real(channel, 0) + end, _transform.real(frame, 0) + begin);
+            std::copy(_transform.imaginary(channel, 0) + begin, _transform.imaginary(channel, 0) + end, _transform.imaginary(frame, 0) + begin);
+            _build_position = end;
+            if (end == bins_count) {
+                _build_stage = stage_measure;
+                _build_position = 0;
+                _build_energy = 0;
+            }
+            return end - begin;
+        }
+        case stage_measure: {
+            auto const frame = tilt_frame();
+            auto const& shaper = _shapers[frame / _channels_count];
+            _build_energy += shaper.tilted_energy(_transform.real(frame, 0), _transform.imaginary(frame, 0), begin, end);
+            _build_position = end;
+            if (end == bins_count) {
+                _build_stage = stage_tilt;
+                _build_position = 0;
+            }
+            return end - begin;
+        }
+        case stage_tilt: {
+            auto const frame = tilt_frame();
+            auto const& shaper = _shapers[frame / _channels_count];
+            auto const factor = SpectralNoiseShaper::normalization(_build_energy, _output_rms);
+            shaper.apply_gains(_transform.real(frame, 0), _transform.imaginary(frame, 0), factor, begin, end);
+            _build_position = end;
+            if (end < bins_count) {
+                return end - begin;
+            }
+            if (_build_step + 1 < frames_count) {
+                ++_build_step;
+                _build_stage = stage_copy;
+                _build_position = 0;
+            }
+            else {
+                next_build_step(frames_count, stage_transform);
+                _transform.start_steps(0);
+            }
+            return end - begin;
+        }
+        case stage_transform: {
+            auto const work = _transform.run_steps(budget);
+            if (_transform.is_stepping()) {
+                return work;
+            }
+            if (++_build_step == frames_count) {
+                _build_stage = stage_tables;
+                _build_step = 0;
+            }
+            else {
+                _transform.start_steps(_build_step);
+            }
+            return work;
+        }
+        case stage_tables: {
+            // the levels of a frame are built in order, each from the one above
+            auto const frame = _build_step / SpectralNoiseTables::levels_count;
+            auto const level = _build_step % SpectralNoiseTables::levels_count;
+            auto const building_tables = colours_count - _playing_tables;
+            auto const level_size = _frame_size >> level;
+            auto const level_end = begin + std::min(level_size - begin, budget);
+            _tables[building_tables + frame / _channels_count].build(frame % _channels_count, level, _transform.samples(frame, 0), begin, level_end);
+            _build_position = level_end;
+            if (level_end < level_size) {
+                return level_end - begin;
+            }
+            _build_position = 0;
+            if (++_build_step == frames_count * SpectralNoiseTables::levels_count) {
+                _playing_tables = building_tables;
+                _is_current = true;
+                _is_building = false;
+            }
+            return level_end - begin;
+        }
+    }
+    return 0;
+}
+
+size_t SpectralNoiseColours::tilt_frame() const {
+    auto const colour = colours_count - 1 - _build_step / _channels_count;
+    return colour * _channels_count + _build_step % _channels_count;
+}
+
+// moves to the next of the stage's steps, or to the first step of the next stage after the last one
+void SpectralNoiseColours::next_build_step(size_t steps_count, BuildStage next_stage) {
+    _build_position = 0;
+    if (++_build_step == steps_count) {
+        _build_stage = next_stage;
+        _build_step = 0;
+    }
+}
+
+SpectralNoiseTables const& SpectralNoiseColours::tables(size_t colour) const {
+    return _tables[_playing_tables + colour];
+}
+
+float SpectralNoiseColours::colour(float db_per_octave) {
+    auto const colour = (db_per_octave - min_db_per_octave) / db_per_octave_step;
+    return std::min(std::max(colour, 0.f), float(colours_count - 1));
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "SpectralNoiseShaper.h"
+#include "SpectralNoiseTables.h"
+#include "SpectralNoiseTransform.h"
+
+// one noise frame at a few quantized tilts, with the tables the voices read each of them through
+// every colour is tilted from the same random spectrum, so crossfading two of them crossfades their gains, coherently
+// a tilt between two colours costs a voice a multiply-add per tap, rather than a transform
+// the frames are only regenerated when the seed changes, into a second set of tables the voices switch to once it is complete
+// buffer k * channels count + c of the transform holds channel c of colour k, on its own
+// nothing is allocated until the voices first play, instances running the other engines never hold the frames or tables
+class SpectralNoiseColours
+{
+public:
+	// colour k is tilted by min_db_per_octave + k * db_per_octave_step, it covers the range of the tilt
+	static constexpr size_t colours_count = 5;
+	static constexpr float min_db_per_octave = -12.f;
+	static constexpr float db_per_octave_step = 6.f;
+
+private:
+	// each stage steps through every channel, colour, or colour and channel, of the frames
+	enum BuildStage {
+		stage_randomize,
+		stage_gains,
+		stage_copy,
+		stage_measure,
+		stage_tilt,
+		stage_transform,
+		stage_tables,
+	};
+
+	size_t _frame_size;
+	size_t _channels_count;
+	bool _is_reproducible;
+	// set once every frame and table is allocated, the audio thread doesn't touch them before
+	std::atomic<bool> _is_allocated;
+	std::atomic<bool> _is_allocation_wanted;
+	// the colours are silent until its plan arrives
+	SpectralNoiseTransform _transform;
+	// one per colour, each keeps the gain table of its tilt
+	std::vector<SpectralNoiseShaper> _shapers;
+	float _output_rms;
+	// two sets of colours_count tables, with every channel, the voices read one while the other is built
+	std::vector<SpectralNoiseTables> _tables;
+	size_t _playing_tables;
+	// the playing tables were built from the current seed
+	bool _is_current;
+
+	uint64_t _seed;
+	uint32_t _stream;
+	bool _is_amortized;
+
+	bool _is_building;
+	BuildStage _build_stage;
+	size_t _build_step;
+	// bin the stages over the bins have reached in the step, and the energy measured for the tilt of its frame
+	size_t _build_position;
+	float _build_energy;
+	uint64_t _build_seed;
+	uint32_t _build_stream;
+	// work of every stage, in bins, samples and the work of the transform steps
+	size_t _build_work;
+	// amortized builds are spread over half a second of samples, as the samplers spread theirs over half of their frame
+	// the frames are much shorter than the samplers', half of one would crowd the build into a few blocks
+	size_t _build_samples;
+
+	void start_build();
+	size_t build_step(size_t budget);
+	// frame of the tilt stages' step, the first colour is tilted last, the others are copied from it
+	size_t tilt_frame() const;
+	void next_build_step(size_t steps_count, BuildStage next_stage);
+
+public:
+	SpectralNoiseColours();
+	// frees the frames and tables of the previous size, they are allocated again by allocate
+	void prepare(size_t frame_size, size_t channels_count, double sample_rate, bool is_reproducible);
+	// allocates the frames and both sets of tables, off the audio thread, builds never do
+	// called once after prepare, by prepareToPlay or once refresh has asked for it
+	void allocate();
+	bool is_allocated() const;
+	bool is_allocation_wanted() const;
+	size_t frame_size() const;
+	size_t channels_count() const;
+	SpectralNoiseTransform& transform();
+	void set_seed(uint64_t seed, uint32_t stream);
+	// amortized builds take about half a second of blocks, the transforms are stepped a row or a column at a time
+	// otherwise the whole build runs in the refresh after a seed change
+	void set_amortized(bool is_amortized);
+	// called once per block from the audio thread, builds the tables once the plan is there and after a seed change
+	// asks for the allocation while there is none
+	void refresh(size_t samples);
+	// the tables stay silent until the first build, there are none before the allocation
+	SpectralNoiseTables const& tables(size_t colour) const;
+	// position of a tilt between the colours, from 0 to colours_count - 1, the tilts past either end are clamped
+	static float colour(float db_per_octave);
+};
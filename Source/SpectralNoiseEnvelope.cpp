@@ -0,0 +1,173 @@
+#include "SpectralNoiseEnvelope.h"
+#include <cmath>
+#include <algorithm>
+#include "SpectralNoiseLanes.h"
+
+// exponential segments are this many time constants long, they end within a thousandth of their target
+static double const time_constants = std::log(1000.0);
+static double const min_ramp_seconds = 0.001;
+
+// gains[i] = start + step * i
+static void linear_ramp(float* gains, size_t count, float start, float step) {
+    constexpr auto lanes = SpectralNoiseLanes::count;
+    float offsets[lanes];
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        offsets[lane] = start + step * float(lane);
+    }
+    auto value = SpectralNoiseLanes::load(offsets);
+    auto const lanes_step = SpectralNoiseLanes::broadcast(step * float(lanes));
+
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        value.store(gains + i);
+        value = value + lanes_step;
+    }
+    for (; i < count; ++i) {
+        gains[i] = start + step * float(i);
+    }
+}
+
+// gains[i] = target + distance * ratio^i
+static void exponential_ramp(float* gains, size_t count, float target, float distance, float ratio) {
+    constexpr auto lanes = SpectralNoiseLanes::count;
+    float distances[lanes];
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        distances[lane] = distance;
+        distance *= ratio;
+    }
+    auto lanes_distance = SpectralNoiseLanes::load(distances);
+    auto const lanes_ratio = SpectralNoiseLanes::broadcast(std::pow(ratio, float(lanes)));
+    auto const lanes_target = SpectralNoiseLanes::broadcast(target);
+
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        (lanes_target + lanes_distance).store(gains + i);
+        lanes_distance = lanes_distance * lanes_ratio;
+    }
+    lanes_distance.store(distances);
+    for (size_t lane = 0; i < count; ++i, ++lane) {
+        gains[i] = target + distances[lane];
+    }
+}
+
+SpectralNoiseEnvelope::Shape SpectralNoiseEnvelope::Shape::from_times(double attack_seconds, double decay_seconds, float sustain, double release_seconds, double sample_rate) {
+    auto const samples = [sample_rate](double seconds) {
+        return std::max(size_t(1), size_t(std::max(seconds, min_ramp_seconds) * sample_rate));
+    };
+    auto const ratio = [](size_t samples) {
+        return float(std::exp(-time_constants / samples));
+    };
+
+    Shape shape;
+    shape.attack_slope = 1.f / samples(attack_seconds);
+    shape.decay_samples = samples(decay_seconds);
+    shape.decay_ratio = ratio(shape.decay_samples);
+    shape.sustain = std::min(std::max(sustain, 0.f), 1.f);
+    shape.release_samples = samples(release_seconds);
+    shape.release_ratio = ratio(shape.release_samples);
+    return shape;
+}
+
+SpectralNoiseEnvelope::SpectralNoiseEnvelope():
+	_stage(stage_idle),
+	_level(0),
+	_velocity(0),
+	_stage_samples(0)
+{}
+
+// a sounding note keeps its gain, the level is rescaled to the new velocity and the attack resumes from there
+// a softer retrigger can leave the level above 1, the attack is then skipped and the decay brings it down
+void SpectralNoiseEnvelope::note_on(float velocity) {
+    if (_stage != stage_idle && velocity > 0) {
+        _level *= _velocity / velocity;
+    }
+    _velocity = velocity;
+    _stage = stage_attack;
+}
+
+void SpectralNoiseEnvelope::note_off(Shape const& shape) {
+    if (_stage != stage_idle) {
+        start_stage(shape, stage_release);
+    }
+}
+
+void SpectralNoiseEnvelope::reset() {
+    _stage = stage_idle;
+    _level = 0;
+}
+
+bool SpectralNoiseEnvelope::is_active() const {
+    return _stage != stage_idle;
+}
+
+bool SpectralNoiseEnvelope::is_released() const {
+    return _stage == stage_release || _stage == stage_idle;
+}
+
+void SpectralNoiseEnvelope::start_stage(Shape const& shape, Stage stage) {
+    _stage = stage;
+    if (stage == stage_decay) {
+        _stage_samples = shape.decay_samples;
+    }
+    else if (stage == stage_release) {
+        _stage_samples = shape.release_samples;
+    }
+}
+
+// the level at the end of each segment is computed directly rather than carried through the ramp
+void SpectralNoiseEnvelope::render(Shape const& shape, float* gains, size_t count) {
+    size_t offset = 0;
+    while (offset < count) {
+        auto const remaining = count - offset;
+        switch (_stage) {
+            case stage_idle:
+            case stage_sustain: {
+                auto const level = _stage == stage_sustain ? shape.sustain : 0.f;
+                _level = level;
+                std::fill(gains + offset, gains + count, level);
+                offset = count;
+                break;
+            }
+            case stage_attack: {
+                auto const attack_samples = _level < 1.f ? size_t(std::ceil((1.f - _level) / shape.attack_slope)) : size_t(0);
+                auto const span = std::min(remaining, attack_samples);
+                linear_ramp(gains + offset, span, _level, shape.attack_slope);
+                offset += span;
+                if (span == attack_samples) {
+                    _level = std::max(_level, 1.f);
+                    start_stage(shape, stage_decay);
+                }
+                else {
+                    _level += shape.attack_slope * span;
+                }
+                break;
+            }
+            case stage_decay:
+            case stage_release: {
+                auto const target = _stage == stage_decay ? shape.sustain : 0.f;
+                auto const ratio = _stage == stage_decay ? shape.decay_ratio : shape.release_ratio;
+                auto const span = std::min(remaining, _stage_samples);
+                auto const distance = _level - target;
+                exponential_ramp(gains + offset, span, target, distance, ratio);
+                offset += span;
+                _stage_samples -= span;
+                _level = target + distance * std::pow(ratio, float(span));
+                if (_stage_samples == 0) {
+                    _level = target;
+                    _stage = _stage == stage_decay ? stage_sustain : stage_idle;
+                }
+                break;
+            }
+        }
+    }
+
+    auto const velocity = SpectralNoiseLanes::broadcast(_velocity);
+    constexpr auto lanes = SpectralNoiseLanes::count;
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        (SpectralNoiseLanes::load(gains + i) * velocity).store(gains + i);
+    }
+    for (; i < count; ++i) {
+        gains[i] *= _velocity;
+    }
+}
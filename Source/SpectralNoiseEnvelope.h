@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// attack, decay, sustain and release gain of one note, scaled by its velocity
+// rendered a segment at a time, each segment is a linear or exponential ramp filled a register at a time
+// retriggers and releases start from the current level, so gains never jump
+class SpectralNoiseEnvelope
+{
+public:
+	// the segments of every envelope, computed once per block from the times
+	struct Shape
+	{
+		// the attack rises linearly, at least over a millisecond so gates never click
+		float attack_slope;
+		// the decay and release approach their targets exponentially, and snap to them once within a thousandth
+		float decay_ratio;
+		size_t decay_samples;
+		float sustain;
+		float release_ratio;
+		size_t release_samples;
+
+		static Shape from_times(double attack_seconds, double decay_seconds, float sustain, double release_seconds, double sample_rate);
+	};
+
+private:
+	enum Stage {
+		stage_idle,
+		stage_attack,
+		stage_decay,
+		stage_sustain,
+		stage_release,
+	};
+
+	Stage _stage;
+	float _level;
+	float _velocity;
+	// samples left in the decay or release
+	size_t _stage_samples;
+
+	void start_stage(Shape const& shape, Stage stage);
+
+public:
+	SpectralNoiseEnvelope();
+	void note_on(float velocity);
+	void note_off(Shape const& shape);
+	void reset();
+	bool is_active() const;
+	bool is_released() const;
+	void render(Shape const& shape, float* gains, size_t count);
+};
@@ -0,0 +1,31 @@
+#include "SpectralNoiseHeadsKernel.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <intrin.h>
+#endif
+
+// the os has to save the avx registers too, cpuid alone only says the cpu has them
+static bool is_avx_supported() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    auto const has_xsave_and_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+    return has_xsave_and_avx && (_xgetbv(0) & 6) == 6;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+#else
+    return false;
+#endif
+}
+
+SpectralNoiseHeads::Kernel const& SpectralNoiseHeads::target_kernel() {
+    static Kernel const kernel { render_heads, add_head_sums };
+    return kernel;
+}
+
+// targets compiled for avx already run it everywhere
+SpectralNoiseHeads::Kernel const& SpectralNoiseHeads::kernel() {
+    static Kernel const& kernel = SpectralNoiseLanes::count < 8 && is_avx_supported() && avx_kernel() != nullptr ? *avx_kernel() : target_kernel();
+    return kernel;
+}
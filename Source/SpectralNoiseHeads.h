@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+
+// the inner loop of the pitched voices, compiled once for the target and once more with avx
+// each register holds a group of heads of one voice, their positions and phases are computed in lanes
+// the taps of each head are gathered, crossfaded between the colours and weighted, then the group is transposed and summed
+// so every lane ends up with one head, the heads accumulate in lanes over every voice of the chunk
+// the lanes are only summed once per output sample, after the last voice
+class SpectralNoiseHeads
+{
+public:
+	// floats kept per sample of the sums, the widest register of any kernel
+	static constexpr size_t max_lanes = 8;
+
+	// one voice's heads over a chunk of one channel
+	struct Chunk
+	{
+		size_t heads_count;
+		size_t count;
+		// positions are split into a whole sample index and a fraction, stored back only when is_storing_positions
+		float* indices;
+		float* fractions;
+		bool is_storing_positions;
+		float const* index_steps;
+		float const* fraction_steps;
+		// the factor from positions in the frame to positions in each head's level
+		float const* level_scales;
+		// each head's level of either colour, and its interpolator's coefficients at phase 0
+		float const* const* lower_levels;
+		float const* const* upper_levels;
+		float const* const* coefficient_tables;
+		float frame_size;
+		// weight of the upper colour at the start of the chunk and per sample
+		float weight;
+		float weight_step;
+		// the voice's gain and its envelope's gain at each sample
+		float gain;
+		float const* gains;
+	};
+
+	struct Kernel
+	{
+		// adds the heads of a chunk to count * max_lanes sums
+		void (*render)(Chunk const& chunk, float* sums);
+		// adds the sums of each sample to the output and clears them
+		void (*add_sums)(float* sums, float* output, size_t count);
+	};
+
+	// the kernel of the target every file is compiled for
+	static Kernel const& target_kernel();
+	// null where avx isn't compiled in
+	static Kernel const* avx_kernel();
+	// the widest kernel the cpu runs, checked the first time
+	static Kernel const& kernel();
+};
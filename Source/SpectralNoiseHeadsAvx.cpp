@@ -0,0 +1,16 @@
+// the project builds this file, and only this one, with avx enabled
+// its kernel is never called on cpus without avx, nothing else in it is shared with the other files
+#include "SpectralNoiseHeads.h"
+
+#if defined(__AVX__)
+	#include "SpectralNoiseHeadsKernel.h"
+#endif
+
+SpectralNoiseHeads::Kernel const* SpectralNoiseHeads::avx_kernel() {
+#if defined(__AVX__)
+    static Kernel const kernel { render_heads, add_head_sums };
+    return &kernel;
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+// the body of the heads' kernels, included by the file of each target
+// it only uses the lanes and plain loops, no library code is compiled for a wider target than the rest of the plugin
+
+#include "SpectralNoiseHeads.h"
+#include "SpectralNoiseLanes.h"
+#include "SpectralNoiseTables.h"
+
+static_assert(SpectralNoiseHeads::max_lanes % SpectralNoiseLanes::count == 0, "the sums hold whole registers");
+static_assert(SpectralNoiseTables::taps % SpectralNoiseLanes::count == 0, "the taps fill whole registers");
+
+// heads are advanced without branches, the fraction carries into the index, which wraps at the frame size
+// positions in a level split into whole samples and a fraction exactly, levels are power of two divisions of the frame
+// the colours share their coefficients, so the taps are crossfaded before they are weighted
+// lanes past the voice's heads are advanced too, their positions are never read
+static void render_heads(SpectralNoiseHeads::Chunk const& chunk, float* sums) {
+    constexpr auto lanes = SpectralNoiseLanes::count;
+    constexpr auto taps = SpectralNoiseTables::taps;
+    auto const zero = SpectralNoiseLanes::broadcast(0.f);
+    auto const one = SpectralNoiseLanes::broadcast(1.f);
+    auto const half = SpectralNoiseLanes::broadcast(0.5f);
+    auto const phases_count = SpectralNoiseLanes::broadcast(float(SpectralNoiseTables::phases_count));
+    auto const taps_count = SpectralNoiseLanes::broadcast(float(taps));
+    auto const frame_size = SpectralNoiseLanes::broadcast(chunk.frame_size);
+    int level_indices[lanes];
+    int phase_offsets[lanes];
+    SpectralNoiseLanes rows[lanes];
+
+    for (size_t group = 0; group < chunk.heads_count; group += lanes) {
+        auto const group_heads_count = chunk.heads_count - group < lanes ? chunk.heads_count - group : lanes;
+        auto const* const lower_levels = chunk.lower_levels + group;
+        auto const* const upper_levels = chunk.upper_levels + group;
+        auto const* const coefficient_tables = chunk.coefficient_tables + group;
+        auto index = SpectralNoiseLanes::load(chunk.indices + group);
+        auto fraction = SpectralNoiseLanes::load(chunk.fractions + group);
+        auto const index_step = SpectralNoiseLanes::load(chunk.index_steps + group);
+        auto const fraction_step = SpectralNoiseLanes::load(chunk.fraction_steps + group);
+        auto const scale = SpectralNoiseLanes::load(chunk.level_scales + group);
+        for (size_t lane = group_heads_count; lane < lanes; ++lane) {
+            rows[lane] = zero;
+        }
+
+        for (size_t i = 0; i < chunk.count; ++i) {
+            // the phase is rounded to the nearest one, as coefficients() does
+            auto const scaled_index = index * scale;
+            auto const level_index = SpectralNoiseLanes::truncate(scaled_index);
+            auto const level_fraction = scaled_index - level_index + fraction * scale;
+            auto const phase = SpectralNoiseLanes::truncate(level_fraction * phases_count + half);
+            level_index.store_truncated(level_indices);
+            (phase * taps_count).store_truncated(phase_offsets);
+
+            auto const weight = SpectralNoiseLanes::broadcast(chunk.weight + chunk.weight_step * float(i));
+            for (size_t lane = 0; lane < group_heads_count; ++lane) {
+                auto const* lower_samples = lower_levels[lane] + level_indices[lane];
+                auto const* upper_samples = upper_levels[lane] + level_indices[lane];
+                auto const* coefficients = coefficient_tables[lane] + phase_offsets[lane];
+                auto row = zero;
+                for (size_t tap = 0; tap < taps; tap += lanes) {
+                    auto const lower_tap = SpectralNoiseLanes::load(lower_samples + tap);
+                    auto const upper_tap = SpectralNoiseLanes::load(upper_samples + tap);
+                    row = row + SpectralNoiseLanes::load(coefficients + tap) * (lower_tap + weight * (upper_tap - lower_tap));
+                }
+                rows[lane] = row;
+            }
+            auto* const sample_sums = sums + i * SpectralNoiseHeads::max_lanes;
+            auto const gain = SpectralNoiseLanes::broadcast(chunk.gain * chunk.gains[i]);
+            (SpectralNoiseLanes::load(sample_sums) + SpectralNoiseLanes::transpose_sum(rows) * gain).store(sample_sums);
+
+            fraction = fraction + fraction_step;
+            auto const carry = SpectralNoiseLanes::where_at_least(fraction, one, one);
+            fraction = fraction - carry;
+            index = index + index_step + carry;
+            index = index - SpectralNoiseLanes::where_at_least(index, frame_size, frame_size);
+        }
+
+        if (chunk.is_storing_positions) {
+            index.store(chunk.indices + group);
+            fraction.store(chunk.fractions + group);
+        }
+    }
+}
+
+// a register of samples at a time, their lanes are transposed and summed together
+static void add_head_sums(float* sums, float* output, size_t count) {
+    constexpr auto lanes = SpectralNoiseLanes::count;
+    constexpr auto stride = SpectralNoiseHeads::max_lanes;
+    auto const zero = SpectralNoiseLanes::broadcast(0.f);
+    SpectralNoiseLanes rows[lanes];
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            rows[lane] = SpectralNoiseLanes::load(sums + (i + lane) * stride);
+            zero.store(sums + (i + lane) * stride);
+        }
+        (SpectralNoiseLanes::load(output + i) + SpectralNoiseLanes::transpose_sum(rows)).store(output + i);
+    }
+    for (; i < count; ++i) {
+        output[i] += SpectralNoiseLanes::load(sums + i * stride).sum();
+        zero.store(sums + i * stride);
+    }
+}
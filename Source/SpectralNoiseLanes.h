@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__AVX__)
+	#include <immintrin.h>
+	#define SPECTRAL_NOISE_LANES_AVX
+	#define SPECTRAL_NOISE_LANES_NAMESPACE lanes_avx
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define SPECTRAL_NOISE_LANES_SSE2
+	#define SPECTRAL_NOISE_LANES_NAMESPACE lanes_sse2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+	#include <arm_neon.h>
+	#define SPECTRAL_NOISE_LANES_NEON
+	#define SPECTRAL_NOISE_LANES_NAMESPACE lanes_neon
+#else
+	#define SPECTRAL_NOISE_LANES_NAMESPACE lanes_scalar
+#endif
+
+// files compiled for a wider target than the rest get their own lanes, the namespace keeps the two apart
+inline namespace SPECTRAL_NOISE_LANES_NAMESPACE {
+
+// floats in the widest register the target is compiled for, a single float on targets without one
+// only float operations are used, apart from the truncating store, so the same code runs on avx, sse2 and neon
+// loads and stores are unaligned, arrays can start anywhere
+struct SpectralNoiseLanes
+{
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+	static constexpr size_t count = 8;
+	__m256 value;
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+	static constexpr size_t count = 4;
+	__m128 value;
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+	static constexpr size_t count = 4;
+	float32x4_t value;
+#else
+	static constexpr size_t count = 1;
+	float value;
+#endif
+
+	static SpectralNoiseLanes broadcast(float x) {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		return { _mm256_set1_ps(x) };
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		return { _mm_set1_ps(x) };
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		return { vdupq_n_f32(x) };
+#else
+		return { x };
+#endif
+	}
+
+	static SpectralNoiseLanes load(float const* values) {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		return { _mm256_loadu_ps(values) };
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		return { _mm_loadu_ps(values) };
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		return { vld1q_f32(values) };
+#else
+		return { *values };
+#endif
+	}
+
+	void store(float* values) const {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		_mm256_storeu_ps(values, value);
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		_mm_storeu_ps(values, value);
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		vst1q_f32(values, value);
+#else
+		*values = value;
+#endif
+	}
+
+	// whole part of each lane, for values from 0 to 2^31
+	void store_truncated(int* values) const {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(values), _mm256_cvttps_epi32(value));
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(values), _mm_cvttps_epi32(value));
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		vst1q_s32(values, vcvtq_s32_f32(value));
+#else
+		*values = int(value);
+#endif
+	}
+
+	friend SpectralNoiseLanes operator+(SpectralNoiseLanes a, SpectralNoiseLanes b) {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		return { _mm256_add_ps(a.value, b.value) };
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		return { _mm_add_ps(a.value, b.value) };
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		return { vaddq_f32(a.value, b.value) };
+#else
+		return { a.value + b.value };
+#endif
+	}
+
+	friend SpectralNoiseLanes operator-(SpectralNoiseLanes a, SpectralNoiseLanes b) {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		return { _mm256_sub_ps(a.value, b.value) };
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		return { _mm_sub_ps(a.value, b.value) };
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		return { vsubq_f32(a.value, b.value) };
+#else
+		return { a.value - b.value };
+#endif
+	}
+
+	friend SpectralNoiseLanes operator*(SpectralNoiseLanes a, SpectralNoiseLanes b) {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		return { _mm256_mul_ps(a.value, b.value) };
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		return { _mm_mul_ps(a.value, b.value) };
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		return { vmulq_f32(a.value, b.value) };
+#else
+		return { a.value * b.value };
+#endif
+	}
+
+	// whole part of values from 0 to 2^31
+	static SpectralNoiseLanes truncate(SpectralNoiseLanes x) {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		return { _mm256_round_ps(x.value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC) };
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		return { _mm_cvtepi32_ps(_mm_cvttps_epi32(x.value)) };
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		return { vcvtq_f32_s32(vcvtq_s32_f32(x.value)) };
+#else
+		return { float(int(x.value)) };
+#endif
+	}
+
+	// value in the lanes where x is at least limit, 0 in the others
+	static SpectralNoiseLanes where_at_least(SpectralNoiseLanes x, SpectralNoiseLanes limit, SpectralNoiseLanes value) {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		return { _mm256_and_ps(_mm256_cmp_ps(x.value, limit.value, _CMP_GE_OQ), value.value) };
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		return { _mm_and_ps(_mm_cmpge_ps(x.value, limit.value), value.value) };
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		return { vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(x.value, limit.value), vreinterpretq_u32_f32(value.value))) };
+#else
+		return { x.value >= limit.value ? value.value : 0.f };
+#endif
+	}
+
+	float sum() const {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		auto const halves = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+		auto const pairs = _mm_add_ps(halves, _mm_movehl_ps(halves, halves));
+		return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		auto const pairs = _mm_add_ps(value, _mm_movehl_ps(value, value));
+		return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		auto const pairs = vadd_f32(vget_low_f32(value), vget_high_f32(value));
+		return vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+#else
+		return value;
+#endif
+	}
+
+	// lane k holds the sum of the lanes of rows[k], for count rows
+	static SpectralNoiseLanes transpose_sum(SpectralNoiseLanes const* rows) {
+#if defined(SPECTRAL_NOISE_LANES_AVX)
+		auto const pairs_0 = _mm256_hadd_ps(rows[0].value, rows[1].value);
+		auto const pairs_1 = _mm256_hadd_ps(rows[2].value, rows[3].value);
+		auto const pairs_2 = _mm256_hadd_ps(rows[4].value, rows[5].value);
+		auto const pairs_3 = _mm256_hadd_ps(rows[6].value, rows[7].value);
+		// each half holds the sums of the same half of rows 0 to 3, then 4 to 7
+		auto const quads_0 = _mm256_hadd_ps(pairs_0, pairs_1);
+		auto const quads_1 = _mm256_hadd_ps(pairs_2, pairs_3);
+		return { _mm256_add_ps(_mm256_permute2f128_ps(quads_0, quads_1, 0x20), _mm256_permute2f128_ps(quads_0, quads_1, 0x31)) };
+#elif defined(SPECTRAL_NOISE_LANES_SSE2)
+		auto row_0 = rows[0].value;
+		auto row_1 = rows[1].value;
+		auto row_2 = rows[2].value;
+		auto row_3 = rows[3].value;
+		_MM_TRANSPOSE4_PS(row_0, row_1, row_2, row_3);
+		return { _mm_add_ps(_mm_add_ps(row_0, row_1), _mm_add_ps(row_2, row_3)) };
+#elif defined(SPECTRAL_NOISE_LANES_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+		return { vpaddq_f32(vpaddq_f32(rows[0].value, rows[1].value), vpaddq_f32(rows[2].value, rows[3].value)) };
+#elif defined(SPECTRAL_NOISE_LANES_NEON)
+		float32x2_t halves[4];
+		for (int row = 0; row < 4; ++row) {
+			halves[row] = vpadd_f32(vget_low_f32(rows[row].value), vget_high_f32(rows[row].value));
+		}
+		return { vcombine_f32(vpadd_f32(halves[0], halves[1]), vpadd_f32(halves[2], halves[3])) };
+#else
+		return rows[0];
+#endif
+	}
+};
+
+}
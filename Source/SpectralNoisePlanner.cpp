@@ -0,0 +1,438 @@
+#include "SpectralNoisePlanner.h"
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// the engines run plans on other arrays than the ones they were planned with
+// every array comes from fftwf_malloc and every channel starts on a padded stride, so they are all aligned alike
+static unsigned int const measured_flags = FFTW_MEASURE;
+static unsigned int const estimated_flags = FFTW_ESTIMATE;
+// the steps of a stepped transform run on rows and columns of its scratch arrays, and on every other sample
+static unsigned int const split_dft_flags = FFTW_ESTIMATE | FFTW_UNALIGNED;
+
+// 64 bytes, the widest simd registers fftw uses
+static size_t const channel_alignment = 16;
+
+// a plan is found by its size, its channels and flags, which include the alignment it was planned for
+// reproducible plans are never shared with the others, which may come from wisdom
+// strides and offsets of a split dft plan's arrays, all zero for c2r plans
+struct DftLayout {
+    int input_stride;
+    int output_stride;
+    int input_offset;
+    int output_offset;
+
+    bool operator==(DftLayout const& other) const {
+        return input_stride == other.input_stride && output_stride == other.output_stride
+            && input_offset == other.input_offset && output_offset == other.output_offset;
+    }
+};
+
+struct SharedPlan {
+    int size;
+    int channels_count;
+    DftLayout layout;
+    unsigned int flags;
+    bool is_reproducible;
+    fftwf_plan plan;
+    size_t references_count;
+};
+
+enum class RequestKind {
+    import_wisdom,
+    plan,
+    plan_from_wisdom,
+    plan_split_dft,
+    release,
+};
+
+struct PlanRequest {
+    RequestKind kind;
+    void const* owner;
+    int size;
+    int channels_count;
+    DftLayout layout;
+    bool is_reproducible;
+    fftwf_plan plan;
+    SpectralNoisePlanner::PlanCallback on_planned;
+};
+
+// guards the fftw calls, only contended once the planning thread has stopped
+static std::mutex planner_mutex;
+static std::vector<SharedPlan> shared_plans;
+static std::string wisdom_path;
+static bool is_wisdom_loaded = false;
+// sizes queued for measuring, with their channel counts
+static std::vector<std::pair<int, int>> pending_sizes;
+static std::atomic<unsigned int> measured_generation(0);
+
+// guards the queue, the planning thread doesn't hold it during its planner calls
+static std::mutex queue_mutex;
+static std::condition_variable queue_condition;
+static std::deque<PlanRequest> requests;
+static std::thread planning_thread;
+static size_t starts_count = 0;
+static bool is_running = false;
+static bool should_stop = false;
+static bool is_servicing = false;
+static void const* servicing_owner = nullptr;
+static bool is_servicing_cancelled = false;
+static bool is_measuring = false;
+static bool is_measurement_cancelled = false;
+
+// planning only looks at the array, measuring also writes it
+// the transform is in place, the samples overwrite the real parts of the bins
+// split plans only run on arrays with the imaginary parts at the same offset as when they were planned
+static fftwf_plan plan_c2r(int size, int channels_count, unsigned int flags) {
+    auto const bins_stride = int(SpectralNoisePlanner::channel_stride(size / 2 + 1));
+    auto const frame_stride = int(SpectralNoisePlanner::channel_stride(size));
+    auto* const samples = fftwf_alloc_real(SpectralNoisePlanner::transform_size(size, channels_count));
+    auto* const imaginary = samples + SpectralNoisePlanner::imaginary_offset(size, channels_count);
+    fftwf_iodim const dimension = { size, 1, 1 };
+    fftwf_iodim const channels_dimension = { channels_count, bins_stride, frame_stride };
+    auto const plan = fftwf_plan_guru_split_dft_c2r(1, &dimension, 1, &channels_dimension, samples, imaginary, samples, flags);
+    fftwf_free(samples);
+    return plan;
+}
+
+// a single backward complex transform, in place when the layouts of both arrays are the same
+// fftw plans forward ones, with the real and imaginary parts swapped they run backward
+// plans only run on arrays with their parts as far apart as when they were planned
+static fftwf_plan plan_split_dft(int size, DftLayout const& layout, unsigned int flags) {
+    auto const input_size = size_t(size - 1) * size_t(layout.input_stride) + size_t(layout.input_offset) + 1;
+    auto const output_size = size_t(size - 1) * size_t(layout.output_stride) + size_t(layout.output_offset) + 1;
+    auto const is_in_place = layout.input_stride == layout.output_stride && layout.input_offset == layout.output_offset;
+    auto* const input = fftwf_alloc_real(is_in_place ? input_size : input_size + output_size);
+    auto* const output = is_in_place ? input : input + input_size;
+    fftwf_iodim const dimension = { size, layout.input_stride, layout.output_stride };
+    auto const plan = fftwf_plan_guru_split_dft(1, &dimension, 0, nullptr, input + layout.input_offset, input, output + layout.output_offset, output, flags);
+    fftwf_free(input);
+    return plan;
+}
+
+// called with planner_mutex held
+// fftw looks up wisdom whatever the rigor of the flags, an estimated plan would take the algorithm measured for its size
+// the wisdom is set aside while it is planned, and put back as it was, estimated plans add to it too
+template <typename Planning>
+static fftwf_plan plan_without_wisdom(Planning planning) {
+    auto* const wisdom = fftwf_export_wisdom_to_string();
+    fftwf_forget_wisdom();
+    auto const plan = planning();
+    fftwf_forget_wisdom();
+    if (wisdom) {
+        fftwf_import_wisdom_from_string(wisdom);
+        std::free(wisdom);
+    }
+    return plan;
+}
+
+// called with planner_mutex held, wisdom only plans are null when the size hasn't been measured
+// split dft plans are always reproducible
+static fftwf_plan acquire_shared_plan(int size, int channels_count, DftLayout const& layout, unsigned int flags, bool is_reproducible) {
+    for (auto& shared_plan : shared_plans) {
+        if (shared_plan.size == size && shared_plan.channels_count == channels_count && shared_plan.layout == layout
+            && shared_plan.flags == flags && shared_plan.is_reproducible == is_reproducible) {
+            ++shared_plan.references_count;
+            return shared_plan.plan;
+        }
+    }
+
+    fftwf_plan plan;
+    if (layout.input_stride > 0) {
+        plan = plan_without_wisdom([=] { return plan_split_dft(size, layout, flags); });
+    }
+    else if (is_reproducible) {
+        plan = plan_without_wisdom([=] { return plan_c2r(size, channels_count, flags); });
+    }
+    else {
+        plan = plan_c2r(size, channels_count, flags);
+    }
+    if (plan) {
+        shared_plans.push_back({ size, channels_count, layout, flags, is_reproducible, plan, 1 });
+    }
+    return plan;
+}
+
+// called with planner_mutex held
+static void release_shared_plan(fftwf_plan plan) {
+    auto const shared_plan = std::find_if(shared_plans.begin(), shared_plans.end(), [plan](SharedPlan const& shared_plan) {
+        return shared_plan.plan == plan;
+    });
+    if (shared_plan == shared_plans.end() || --shared_plan->references_count > 0) {
+        return;
+    }
+    fftwf_destroy_plan(plan);
+    shared_plans.erase(shared_plan);
+}
+
+// called with planner_mutex held, returns the plan the request asked for, if any
+static fftwf_plan service(PlanRequest const& request, bool& is_estimated) {
+    is_estimated = false;
+    switch (request.kind) {
+        case RequestKind::import_wisdom:
+            // a missing or unreadable file leaves the wisdom empty, plans are then measured as they are needed
+            fftwf_import_wisdom_from_filename(wisdom_path.c_str());
+            return nullptr;
+
+        case RequestKind::plan: {
+            is_estimated = true;
+            if (request.is_reproducible) {
+                return acquire_shared_plan(request.size, request.channels_count, {}, estimated_flags, true);
+            }
+            auto const plan = acquire_shared_plan(request.size, request.channels_count, {}, measured_flags | FFTW_WISDOM_ONLY, false);
+            if (plan) {
+                is_estimated = false;
+                return plan;
+            }
+            auto const pending_size = std::make_pair(request.size, request.channels_count);
+            if (std::find(pending_sizes.begin(), pending_sizes.end(), pending_size) == pending_sizes.end()) {
+                pending_sizes.push_back(pending_size);
+            }
+            return acquire_shared_plan(request.size, request.channels_count, {}, estimated_flags, false);
+        }
+
+        case RequestKind::plan_from_wisdom:
+            return acquire_shared_plan(request.size, request.channels_count, {}, measured_flags | FFTW_WISDOM_ONLY, false);
+
+        case RequestKind::plan_split_dft:
+            is_estimated = true;
+            return acquire_shared_plan(request.size, 1, request.layout, split_dft_flags, true);
+
+        case RequestKind::release:
+            release_shared_plan(request.plan);
+            return nullptr;
+    }
+    return nullptr;
+}
+
+// the measured plan is only kept as wisdom, samplers then plan from it
+// a cancelled measurement leaves no wisdom, fftw falls back to an estimated plan, returns whether the size was measured
+static bool measure(int size, int channels_count) {
+    std::lock_guard<std::mutex> planner_lock(planner_mutex);
+    fftwf_destroy_plan(plan_c2r(size, channels_count, measured_flags));
+    auto const plan = plan_c2r(size, channels_count, measured_flags | FFTW_WISDOM_ONLY);
+    if (!plan) {
+        return false;
+    }
+    fftwf_destroy_plan(plan);
+    if (!wisdom_path.empty()) {
+        fftwf_export_wisdom_to_filename(wisdom_path.c_str());
+    }
+    ++measured_generation;
+    return true;
+}
+
+// called with queue_mutex held, a measurement takes seconds and holds the planner, nothing waits behind it
+// fftw checks its time limit after each timing, a limit of zero ends the search there without wisdom
+// the planner is busy on the planning thread, only the limit is written from here
+static void cancel_measurement() {
+    if (is_measuring && !is_measurement_cancelled) {
+        is_measurement_cancelled = true;
+        fftwf_set_timelimit(0);
+    }
+}
+
+// requests come first, queued sizes are measured while there are none
+// a request or a stop during a measurement cancels it, the size is measured over once the queue is empty again
+static void run() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true) {
+        if (!requests.empty()) {
+            auto request = std::move(requests.front());
+            requests.pop_front();
+            is_servicing = true;
+            servicing_owner = request.owner;
+            is_servicing_cancelled = false;
+            lock.unlock();
+
+            bool is_estimated;
+            fftwf_plan plan;
+            {
+                std::lock_guard<std::mutex> planner_lock(planner_mutex);
+                plan = service(request, is_estimated);
+            }
+
+            lock.lock();
+            if (request.on_planned && !is_servicing_cancelled) {
+                request.on_planned(plan, is_estimated);
+            }
+            else if (plan) {
+                std::lock_guard<std::mutex> planner_lock(planner_mutex);
+                release_shared_plan(plan);
+            }
+            is_servicing = false;
+            servicing_owner = nullptr;
+            queue_condition.notify_all();
+        }
+        else if (should_stop) {
+            is_running = false;
+            queue_condition.notify_all();
+            return;
+        }
+        else if (!pending_sizes.empty()) {
+            auto const pending_size = pending_sizes.back();
+            pending_sizes.pop_back();
+            is_measuring = true;
+            lock.unlock();
+            auto const is_measured = measure(pending_size.first, pending_size.second);
+            lock.lock();
+            if (is_measurement_cancelled) {
+                std::lock_guard<std::mutex> planner_lock(planner_mutex);
+                fftwf_set_timelimit(FFTW_NO_TIMELIMIT);
+            }
+            if (!is_measured && is_measurement_cancelled) {
+                pending_sizes.push_back(pending_size);
+            }
+            is_measuring = false;
+            is_measurement_cancelled = false;
+        }
+        else {
+            queue_condition.wait(lock);
+        }
+    }
+}
+
+// called with queue_mutex held, services the request on the caller's thread if the planning thread isn't running
+static void enqueue(PlanRequest request) {
+    if (is_running) {
+        requests.push_back(std::move(request));
+        cancel_measurement();
+        queue_condition.notify_all();
+        return;
+    }
+
+    bool is_estimated;
+    fftwf_plan plan;
+    {
+        std::lock_guard<std::mutex> planner_lock(planner_mutex);
+        plan = service(request, is_estimated);
+    }
+    if (request.on_planned) {
+        request.on_planned(plan, is_estimated);
+    }
+}
+
+void SpectralNoisePlanner::start(std::string const& path) {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if (starts_count++ > 0) {
+        return;
+    }
+    // the thread of a previous stop may still be finishing its queue
+    queue_condition.wait(lock, [] { return !is_running; });
+
+    should_stop = false;
+    is_running = true;
+    planning_thread = std::thread(run);
+    if (!is_wisdom_loaded) {
+        is_wisdom_loaded = true;
+        wisdom_path = path;
+        enqueue({ RequestKind::import_wisdom, nullptr, 0, 0, {}, false, nullptr, nullptr });
+    }
+}
+
+void SpectralNoisePlanner::stop() {
+    std::thread stopped_thread;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (starts_count == 0 || --starts_count > 0) {
+            return;
+        }
+        should_stop = true;
+        cancel_measurement();
+        queue_condition.notify_all();
+        stopped_thread = std::move(planning_thread);
+    }
+    stopped_thread.join();
+}
+
+void SpectralNoisePlanner::request_c2r(void const* owner, int size, int channels_count, bool is_reproducible, PlanCallback on_planned) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    enqueue({ RequestKind::plan, owner, size, channels_count, {}, is_reproducible, nullptr, std::move(on_planned) });
+}
+
+void SpectralNoisePlanner::request_c2r_from_wisdom(void const* owner, int size, int channels_count, PlanCallback on_planned) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    enqueue({ RequestKind::plan_from_wisdom, owner, size, channels_count, {}, false, nullptr, std::move(on_planned) });
+}
+
+void SpectralNoisePlanner::request_split_dft(void const* owner, int size, int input_stride, int output_stride, int input_offset, int output_offset, PlanCallback on_planned) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    enqueue({ RequestKind::plan_split_dft, owner, size, 1, { input_stride, output_stride, input_offset, output_offset }, true, nullptr, std::move(on_planned) });
+}
+
+// a request being serviced can't be taken back, its plan is released by the planning thread instead
+void SpectralNoisePlanner::cancel(void const* owner) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    requests.erase(std::remove_if(requests.begin(), requests.end(), [owner](PlanRequest const& request) {
+        return request.owner == owner;
+    }), requests.end());
+    if (is_servicing && servicing_owner == owner) {
+        is_servicing_cancelled = true;
+    }
+}
+
+void SpectralNoisePlanner::wait_for_requests() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_condition.wait(lock, [] {
+        return !is_running || (requests.empty() && !is_servicing);
+    });
+}
+
+void SpectralNoisePlanner::release(fftwf_plan plan) {
+    if (!plan) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    enqueue({ RequestKind::release, nullptr, 0, 0, {}, false, plan, nullptr });
+}
+
+unsigned int SpectralNoisePlanner::wisdom_generation() {
+    return measured_generation.load();
+}
+
+size_t SpectralNoisePlanner::channel_stride(size_t count) {
+    return (count + channel_alignment - 1) / channel_alignment * channel_alignment;
+}
+
+size_t SpectralNoisePlanner::imaginary_offset(size_t size, size_t channels_count) {
+    return channel_stride(size) * channels_count;
+}
+
+size_t SpectralNoisePlanner::transform_size(size_t size, size_t channels_count) {
+    return imaginary_offset(size, channels_count) + channel_stride(size / 2 + 1) * channels_count;
+}
+
+// even sizes with large prime factors, like the sample rate of some hosts, fall back to slow generic algorithms
+size_t SpectralNoisePlanner::frame_size(double sample_rate, double duration, FrameSizePolicy policy, size_t halvings) {
+    auto const target = std::max(2.0, sample_rate * duration);
+    auto const distance = [target](size_t size) {
+        return std::abs(double(size) - target);
+    };
+
+    auto const min_size = size_t(1) << std::max(halvings, size_t(1));
+    size_t best_size = min_size;
+    for (size_t power_of_two = min_size; power_of_two < 2 * target; power_of_two *= 2) {
+        if (policy == FrameSizePolicy::power_of_two) {
+            if (distance(power_of_two) < distance(best_size)) {
+                best_size = power_of_two;
+            }
+            continue;
+        }
+        for (size_t power_of_three = power_of_two; power_of_three < 2 * target; power_of_three *= 3) {
+            for (size_t size = power_of_three; size < 2 * target; size *= 5) {
+                if (distance(size) < distance(best_size)) {
+                    best_size = size;
+                }
+            }
+        }
+    }
+    return best_size;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <functional>
+#include "fftw-3.3/api/fftw3.h"
+
+enum class FrameSizePolicy {
+	// products of 2, 3 and 5, which fftw has its fastest codelets for
+	fast,
+	power_of_two,
+};
+
+// every fftw planner call of the noise engines goes through here, the planner is not thread safe
+// a single planning thread makes and destroys the plans, callers queue requests and get called back
+// plans are shared by every sampler of the process, and counted, a size is only planned once
+// a plan transforms every channel of a sampler at once, in place, through the new-array split execute interface
+// the array holds the real parts of the bins, which the samples overwrite, then the imaginary parts at imaginary_offset
+// channel c of the samples starts at c * channel_stride(size), of either part at c * channel_stride(size / 2 + 1)
+// plans assume aligned arrays, the caller's come from fftwf_malloc
+// measured plans are saved as wisdom to a per user file, so later sessions get them without measuring
+class SpectralNoisePlanner
+{
+public:
+	// called with the planner's queue locked, from the planning thread, or the caller's while it isn't running
+	// it should only store the plan
+	// the plan is null if planning failed, or if a wisdom only request found no wisdom
+	using PlanCallback = std::function<void(fftwf_plan plan, bool is_estimated)>;
+
+	// the first call starts the planning thread and imports the wisdom saved by earlier sessions
+	static void start(std::string const& wisdom_path);
+	// the thread stops with the last start, after the requests already queued, a measurement in progress is cut short
+	// plans released after that are destroyed on the caller's thread
+	static void stop();
+
+	// a plan from wisdom, or an estimated one while the size is queued for measuring
+	// reproducible plans are always estimated, without the wisdom, measured ones depend on timings
+	static void request_c2r(void const* owner, int size, int channels_count, bool is_reproducible, PlanCallback on_planned);
+	// null until the size has been measured
+	static void request_c2r_from_wisdom(void const* owner, int size, int channels_count, PlanCallback on_planned);
+	// a single backward complex transform on split, unaligned arrays, always estimated and reproducible
+	// the imaginary parts are at the offsets from the real ones, the plan is in place when both arrays are laid out alike
+	// it runs with the real and imaginary arrays swapped, in and out, through fftwf_execute_split_dft
+	static void request_split_dft(void const* owner, int size, int input_stride, int output_stride, int input_offset, int output_offset, PlanCallback on_planned);
+	// drops the owner's queued requests, its callbacks are not called after this returns
+	static void cancel(void const* owner);
+	// waits for the requests queued so far, a measurement in progress is cut short rather than waited for
+	static void wait_for_requests();
+	// every planned plan is released once, null is ignored
+	static void release(fftwf_plan plan);
+
+	// changes whenever sizes have been measured, estimated plans can then be upgraded
+	static unsigned int wisdom_generation();
+
+	// count rounded up so every channel of an aligned array starts aligned
+	static size_t channel_stride(size_t count);
+	static size_t imaginary_offset(size_t size, size_t channels_count);
+	// floats in the array a transform runs on
+	static size_t transform_size(size_t size, size_t channels_count);
+	// the even size allowed by the policy nearest to duration seconds of samples
+	// sizes can be halved halvings times and stay whole
+	static size_t frame_size(double sample_rate, double duration, FrameSizePolicy policy, size_t halvings = 1);
+};
@@ -0,0 +1,75 @@
+#include "SpectralNoiseRandom.h"
+#include <algorithm>
+
+namespace {
+    // counters go through the rounds in batches laid out lane by lane, so the compiler can vectorize each step
+    constexpr size_t batch_blocks = 16;
+    constexpr size_t pairs_per_block = 2;
+    constexpr size_t batch_pairs = batch_blocks * pairs_per_block;
+    constexpr int rounds = 10;
+
+    constexpr uint32_t multiplier_0 = 0xD2511F53;
+    constexpr uint32_t multiplier_1 = 0xCD9E8D57;
+    constexpr uint32_t weyl_0 = 0x9E3779B9;
+    constexpr uint32_t weyl_1 = 0xBB67AE85;
+}
+
+SpectralNoiseRandom::SpectralNoiseRandom():
+	_key { 0, 0 },
+	_stream(0)
+{}
+
+void SpectralNoiseRandom::set_seed(uint64_t seed, uint32_t stream) {
+    _key[0] = uint32_t(seed);
+    _key[1] = uint32_t(seed >> 32);
+    _stream = stream;
+}
+
+void SpectralNoiseRandom::fill(float* first, float* second, size_t begin, size_t end, uint64_t frame_index) const {
+    auto const frame_low = uint32_t(frame_index);
+    auto const frame_high = uint32_t(frame_index >> 32);
+
+    uint32_t c0[batch_blocks], c1[batch_blocks], c2[batch_blocks], c3[batch_blocks];
+    float first_batch[batch_pairs], second_batch[batch_pairs];
+
+    for (size_t batch_begin = begin - begin % batch_pairs; batch_begin < end; batch_begin += batch_pairs) {
+        auto const first_block = uint32_t(batch_begin / pairs_per_block);
+        for (size_t lane = 0; lane < batch_blocks; ++lane) {
+            c0[lane] = first_block + uint32_t(lane);
+            c1[lane] = frame_low;
+            c2[lane] = frame_high;
+            c3[lane] = _stream;
+        }
+
+        uint32_t key_0 = _key[0];
+        uint32_t key_1 = _key[1];
+        for (int round = 0; round < rounds; ++round) {
+            for (size_t lane = 0; lane < batch_blocks; ++lane) {
+                auto const product_0 = uint64_t(multiplier_0) * c0[lane];
+                auto const product_1 = uint64_t(multiplier_1) * c2[lane];
+                auto const next_c0 = uint32_t(product_1 >> 32) ^ c1[lane] ^ key_0;
+                auto const next_c2 = uint32_t(product_0 >> 32) ^ c3[lane] ^ key_1;
+                c1[lane] = uint32_t(product_1);
+                c3[lane] = uint32_t(product_0);
+                c0[lane] = next_c0;
+                c2[lane] = next_c2;
+            }
+            key_0 += weyl_0;
+            key_1 += weyl_1;
+        }
+
+        // signed 32 bit integers scaled to [-1, 1), a block holds two pairs
+        auto const scale = 1.f / 2147483648.f;
+        for (size_t lane = 0; lane < batch_blocks; ++lane) {
+            first_batch[lane * pairs_per_block + 0] = float(int32_t(c0[lane])) * scale;
+            second_batch[lane * pairs_per_block + 0] = float(int32_t(c1[lane])) * scale;
+            first_batch[lane * pairs_per_block + 1] = float(int32_t(c2[lane])) * scale;
+            second_batch[lane * pairs_per_block + 1] = float(int32_t(c3[lane])) * scale;
+        }
+
+        auto const copy_begin = std::max(begin, batch_begin);
+        auto const copy_end = std::min(end, batch_begin + batch_pairs);
+        std::copy(first_batch + (copy_begin - batch_begin), first_batch + (copy_end - batch_begin), first + copy_begin);
+        std::copy(second_batch + (copy_begin - batch_begin), second_batch + (copy_end - batch_begin), second + copy_begin);
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// philox4x32-10 counter based generator
+// a value only depends on the seed, the stream, the frame and its position in the frame,
+// so frames can be generated in any order, a slice at a time, without state or system calls
+class SpectralNoiseRandom
+{
+	uint32_t _key[2];
+	uint32_t _stream;
+
+public:
+	SpectralNoiseRandom();
+	void set_seed(uint64_t seed, uint32_t stream);
+	// fills pairs begin to end of the frame with uniform floats in [-1, 1), split between two arrays
+	// the arrays point to pair 0 of the frame, the values of a pair are consecutive in the sequence
+	void fill(float* first, float* second, size_t begin, size_t end, uint64_t frame_index) const;
+};
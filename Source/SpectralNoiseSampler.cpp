@@ -1,87 +1,330 @@
 #include "SpectralNoiseSampler.h"
 #include <cmath>
-#include <functional>
-#include <random>
 #include <cstdlib>
-#include <complex>
-#include "fftw-3.3/api/fftw3.h"
+#include <algorithm>
 
 SpectralNoiseSampler::SpectralNoiseSampler():
+	_frame_size(0),
+	_channels_count(0),
+	_output_rms(0),
+	_next_buffer_version(0),
+	_next_buffer_frame_index(0),
+	_next_buffer_state(next_buffer_empty),
+	_next_frame_index(0),
 	_index(0),
-	_db_per_octave(0)
-{
-    _fft_plan = fftwf_plan_dft_c2r_1d(_buffer.size(), reinterpret_cast<fftwf_complex*>(_fourrier_buffer.data()), _buffer.data(), FFTW_MEASURE);
+	_buffer_version(0),
+	_db_per_octave(0),
+	_seed(0),
+	_stream(0),
+	_spectrum_version(0),
+	_regeneration_mode(RegenerationMode::synchronous),
+	_is_amortizing(false),
+	_amortized_stage(stage_randomize),
+	_amortized_position(0),
+	_amortized_version(0),
+	_amortized_frame_index(0),
+	_amortized_seed(0),
+	_amortized_stream(0),
+	_amortized_db_per_octave(0)
+{}
+
+void SpectralNoiseSampler::set_buffer_size(size_t buffer_size, size_t channels_count, double sample_rate, bool is_reproducible) {
+    buffer_size = buffer_size + buffer_size % 2;  // ensure buffer size is even
+    _frame_size = buffer_size;
+    _channels_count = channels_count;
+    _transform.set_size(buffer_size, channels_count, 2, is_reproducible, TransformExecution::both);
+    _amortized_energies.resize(channels_count);
+    _next_buffer_state = next_buffer_empty;
+    _next_frame_index = 0;
+    _is_amortizing = false;
+    // silent and stale until the plan arrives and the first buffer is rendered
+    _buffer_version = _spectrum_version.load() - 1;
+    _index = 0;
+    _shaper.set_frame_size(buffer_size, sample_rate);
+    _next_shaper.set_frame_size(buffer_size, sample_rate);
+    _output_rms = SpectralNoiseShaper::output_rms(sample_rate);
 }
 
-SpectralNoiseSampler::~SpectralNoiseSampler() {
-    fftwf_destroy_plan(_fft_plan);
+size_t SpectralNoiseSampler::channels_count() const {
+    return _channels_count;
 }
 
-void SpectralNoiseSampler::set_buffer_size(size_t buffer_size) {
-    buffer_size = buffer_size + buffer_size % 2;  // ensure buffer size is even
-    fftwf_destroy_plan(_fft_plan);
-    _buffer.resize(buffer_size);
-    _fourrier_buffer.resize(buffer_size/2 + 1);
-    _fft_plan = fftwf_plan_dft_c2r_1d(_buffer.size(), (fftwf_complex*)_fourrier_buffer.data(), _buffer.data(), FFTW_MEASURE);
+size_t SpectralNoiseSampler::frame_size() const {
+    return _frame_size;
+}
+
+SpectralNoiseTransform& SpectralNoiseSampler::transform() {
+    return _transform;
+}
+
+// the shapers take the seed when they render, the worker may be using one of them
+void SpectralNoiseSampler::set_seed(uint64_t seed, uint32_t stream) {
+    if (_seed == seed && _stream == stream) {
+        return;
+    }
+    _seed = seed;
+    _stream = stream;
+    ++_spectrum_version;
 }
 
 void SpectralNoiseSampler::set_db_per_octave(float db_per_octave) {
 	_db_per_octave = db_per_octave;
+	++_spectrum_version;
+}
+
+void SpectralNoiseSampler::set_regeneration_mode(RegenerationMode regeneration_mode) {
+	if (_is_amortizing && regeneration_mode != RegenerationMode::amortized) {
+		// hand the half built buffer back, the worker starts over if it takes over
+		_is_amortizing = false;
+		_next_buffer_state = next_buffer_empty;
+	}
+	_regeneration_mode = regeneration_mode;
 }
 
 void SpectralNoiseSampler::resample_noise() {
-    if (_buffer.empty()) {
+    if (_transform.is_empty() || !_transform.is_planned()) {
+        return;
+    }
+
+    auto const frame_index = _next_frame_index.load();
+    _buffer_version = _spectrum_version;
+    render_buffer(playing_buffer, _shaper, frame_index);
+    _next_frame_index = frame_index + 1;
+    _index = 0;
+}
+
+// called repeatedly from the worker thread, renders the buffer that plays after the current one
+void SpectralNoiseSampler::prepare_next_buffer() {
+    if (_transform.is_empty() || !_transform.is_planned() || _regeneration_mode != RegenerationMode::background) {
         return;
     }
 
-    // generate gaussian spectral noise with expected norm of 1
-    std::mt19937 generator(std::random_device{}());
-    //std::normal_distribution<float> distribution(0.f, 0.5f); // 2.f / M_PI
-    std::uniform_real_distribution<float> distribution(-1.f, 1.f);
-    std::generate(
-        reinterpret_cast<float*>(&*_fourrier_buffer.begin()),
-        reinterpret_cast<float*>(&*_fourrier_buffer.end() + 1),
-        std::bind(distribution, generator)
-    );
+    auto state = _next_buffer_state.load();
+    if (state == next_buffer_busy || (state == next_buffer_ready && is_next_buffer_current())) {
+        return;
+    }
+    // the audio thread may take a stale ready buffer before we get to re-render it
+    if (!_next_buffer_state.compare_exchange_strong(state, next_buffer_busy)) {
+        return;
+    }
 
-    auto const min_frequency = 20;
-    auto const normalization = std::sqrt(float(_buffer.size()));
-    for (size_t frequency = 0; frequency < _fourrier_buffer.size(); ++frequency) {
-        auto& coefficient = reinterpret_cast<std::complex<float>&>(_fourrier_buffer[frequency]);
+    auto const version = _spectrum_version.load();
+    auto const frame_index = _next_frame_index.load();
+    render_buffer(next_buffer, _next_shaper, frame_index);
+    _next_buffer_version = version;
+    _next_buffer_frame_index = frame_index;
+    _next_buffer_state = next_buffer_ready;
+}
 
-        if (frequency < min_frequency) {
-            coefficient = 0;
+// called once per block from the audio thread, does an amount of work proportional to the block length
+// the rate is set so that the next buffer is complete by the time half of the current one has played
+void SpectralNoiseSampler::advance_next_buffer(size_t samples) {
+    if (_transform.is_empty() || !_transform.is_planned() || _regeneration_mode != RegenerationMode::amortized) {
+        return;
+    }
+
+    if (!_is_amortizing) {
+        auto state = _next_buffer_state.load();
+        if (state == next_buffer_busy || (state == next_buffer_ready && is_next_buffer_current())) {
+            return;
         }
-        else {
-            auto const pivot_frequency = 1000.0;
+        if (!_next_buffer_state.compare_exchange_strong(state, next_buffer_busy)) {
+            return;
+        }
+        start_amortized_buffer();
+    }
+    else if (_amortized_version != _spectrum_version.load()) {
+        start_amortized_buffer();
+    }
 
-            auto const octaves_from_pivot = std::log2(frequency / pivot_frequency);
-            auto const scaling_db = _db_per_octave * octaves_from_pivot;
-            auto const scaling_factor = std::pow(10.0, scaling_db / 20.0);
-            coefficient *= float(scaling_factor);
+    // the gain table is shared by the channels, the other stages run over every channel's bins, then the transform steps
+    auto const bins_count = _next_shaper.bins_count();
+    auto const channels_bins_count = _channels_count * bins_count;
+    auto const total_work = 3 * channels_bins_count + bins_count + _transform.steps_work();
+    auto const budget = (2 * total_work * samples + _frame_size - 1) / _frame_size;
+
+    size_t work = 0;
+    while (_is_amortizing && work < budget) {
+        // slices of the channel stages stop at the end of a channel
+        auto const channel = std::min(_amortized_position / bins_count, _channels_count - 1);
+        auto const channel_begin = channel * bins_count;
+        auto* const channel_real = _transform.real(next_buffer, channel);
+        auto* const channel_imaginary = _transform.imaginary(next_buffer, channel);
+        auto const channel_end = std::min(channel_begin + bins_count, _amortized_position + budget - work);
+
+        switch (_amortized_stage) {
+            case stage_randomize: {
+                _next_shaper.set_seed(_amortized_seed, _amortized_stream + uint32_t(channel));
+                _next_shaper.randomize(channel_real, channel_imaginary, _amortized_position - channel_begin, channel_end - channel_begin, _amortized_frame_index);
+                work += channel_end - _amortized_position;
+                _amortized_position = channel_end;
+                if (channel_end == channels_bins_count) {
+                    _amortized_stage = stage_gains;
+                    _amortized_position = 0;
+                }
+                break;
+            }
+            case stage_gains: {
+                // the table only needs rebuilding after a tilt change
+                if (_next_shaper.are_gains_valid(_amortized_db_per_octave)) {
+                    _amortized_stage = stage_measure;
+                    _amortized_position = 0;
+                    std::fill(_amortized_energies.begin(), _amortized_energies.end(), 0.f);
+                    break;
+                }
+                auto const end = std::min(bins_count, _amortized_position + budget - work);
+                _next_shaper.build_gains(_amortized_db_per_octave, _amortized_position, end);
+                work += end - _amortized_position;
+                _amortized_position = end;
+                break;
+            }
+            case stage_measure: {
+                _amortized_energies[channel] += _next_shaper.tilted_energy(channel_real, channel_imaginary, _amortized_position - channel_begin, channel_end - channel_begin);
+                work += channel_end - _amortized_position;
+                _amortized_position = channel_end;
+                if (channel_end == channels_bins_count) {
+                    _amortized_stage = stage_tilt;
+                    _amortized_position = 0;
+                }
+                break;
+            }
+            case stage_tilt: {
+                auto const factor = SpectralNoiseShaper::normalization(_amortized_energies[channel], _output_rms);
+                _next_shaper.apply_gains(channel_real, channel_imaginary, factor, _amortized_position - channel_begin, channel_end - channel_begin);
+                work += channel_end - _amortized_position;
+                _amortized_position = channel_end;
+                if (channel_end == channels_bins_count) {
+                    _amortized_stage = stage_transform;
+                    _amortized_position = 0;
+                    _transform.start_steps(next_buffer);
+                }
+                break;
+            }
+            case stage_transform: {
+                // a row or a column at a time, the last one leaves the buffer complete
+                work += _transform.run_steps(budget - work);
+                if (_transform.is_stepping()) {
+                    break;
+                }
+                _is_amortizing = false;
+                _next_buffer_version = _amortized_version;
+                _next_buffer_frame_index = _amortized_frame_index;
+                _next_buffer_state = next_buffer_ready;
+                return;
+            }
         }
     }
+}
 
-    fftwf_execute(_fft_plan);
+void SpectralNoiseSampler::start_amortized_buffer() {
+    _is_amortizing = true;
+    _amortized_stage = stage_randomize;
+    _amortized_position = 0;
+    _amortized_version = _spectrum_version.load();
+    _amortized_frame_index = _next_frame_index.load();
+    _amortized_db_per_octave = _db_per_octave.load();
+    _amortized_seed = _seed.load();
+    _amortized_stream = _stream.load();
+}
 
-    float root_sum = 0;
-    for (const float& sample: _buffer) {
-        root_sum += sample * sample;
+// the shaper draws each channel from its own stream, the gain table is only built for the first one
+void SpectralNoiseSampler::render_buffer(size_t buffer, SpectralNoiseShaper& shaper, uint64_t frame_index) {
+    auto const seed = _seed.load();
+    auto const stream = _stream.load();
+    auto const db_per_octave = _db_per_octave.load();
+    for (size_t channel = 0; channel < _channels_count; ++channel) {
+        shaper.set_seed(seed, stream + uint32_t(channel));
+        shaper.fill(_transform.real(buffer, channel), _transform.imaginary(buffer, channel), db_per_octave, frame_index, _output_rms);
     }
-    const float root_mean_square = std::sqrt(root_sum / _buffer.size());
-    for (float& sample: _buffer) {
-        sample *= 64 / (normalization * root_mean_square);
+    _transform.execute(buffer);
+}
+
+// the next buffer holds the frame that follows the playing one, with the current tilt
+bool SpectralNoiseSampler::is_next_buffer_current() const {
+    return _next_buffer_version == _spectrum_version.load(std::memory_order_relaxed)
+        && _next_buffer_frame_index == _next_frame_index.load(std::memory_order_relaxed);
+}
+
+// takes the buffer prepared by the worker thread or the amortized slices, if any
+// a buffer rendered with the current tilt replaces the playing one right away, a stale one only at the wrap point
+bool SpectralNoiseSampler::swap_next_buffer(bool is_wrapping) {
+    auto state = _next_buffer_state.load();
+    if (state != next_buffer_ready) {
+        return false;
+    }
+    if (!is_wrapping && !is_next_buffer_current()) {
+        return false;
+    }
+    if (!_next_buffer_state.compare_exchange_strong(state, next_buffer_busy)) {
+        return false;
     }
 
+    _transform.swap_buffers(playing_buffer, next_buffer);
+    _buffer_version = _next_buffer_version;
+    _next_frame_index = _next_buffer_frame_index + 1;
+    _next_buffer_state = next_buffer_empty;
     _index = 0;
+    return true;
+}
+
+// picks up the next buffer at the wrap point, or a pending tilt or seed change, before reading from _index
+void SpectralNoiseSampler::update_buffer() {
+    bool const is_wrapping = _index >= _frame_size;
+    bool const is_stale = _buffer_version != _spectrum_version.load(std::memory_order_relaxed);
+    if (is_wrapping || is_stale) {
+        if (_regeneration_mode == RegenerationMode::synchronous) {
+            resample_noise();
+        }
+        else {
+            swap_next_buffer(is_wrapping);
+        }
+        // the next buffer is late or the plan hasn't arrived, loop the current one rather than render it all at once
+        if (_index >= _frame_size) {
+            _index = 0;
+        }
+    }
 }
 
-float SpectralNoiseSampler::next_sample() {
-    if (_buffer.empty()) {
-        return 0;
+// a tilt or seed change is picked up by the next render in synchronous mode, the way it is during playback
+// background and amortized buffers are only taken while the playing one is stale, at their usual rate
+// once it is current nothing is swapped, so the frames don't advance, and at most the next one is built until playback resumes
+void SpectralNoiseSampler::idle(size_t samples) {
+    if (_transform.is_empty() || !_transform.want_plan()) {
+        return;
+    }
+
+    if (_regeneration_mode == RegenerationMode::synchronous) {
+        // nothing has been rendered since the buffer size was set
+        if (_next_frame_index.load(std::memory_order_relaxed) == 0) {
+            resample_noise();
+        }
+        return;
+    }
+    if (_buffer_version != _spectrum_version.load(std::memory_order_relaxed)) {
+        advance_next_buffer(samples);
+        swap_next_buffer(false);
     }
-    if (_index >= _buffer.size()) {
-        resample_noise();
+}
+
+// copies contiguous spans of the buffer, the wrap point is handled once per span for every channel
+void SpectralNoiseSampler::render(float* const* channels, size_t channels_count, size_t count) {
+    auto const rendered_channels_count = _transform.is_empty() ? 0 : std::min(channels_count, _channels_count);
+    for (size_t channel = rendered_channels_count; channel < channels_count; ++channel) {
+        std::fill(channels[channel], channels[channel] + count, 0.f);
+    }
+    if (rendered_channels_count == 0) {
+        return;
+    }
+    _transform.want_plan();
+
+    size_t offset = 0;
+    while (offset < count) {
+        update_buffer();
+        auto const span = std::min(count - offset, _frame_size - _index);
+        for (size_t channel = 0; channel < rendered_channels_count; ++channel) {
+            std::copy_n(_transform.samples(playing_buffer, channel) + _index, span, channels[channel] + offset);
+        }
+        _index += span;
+        offset += span;
     }
-    return _buffer[_index++];
 }
@@ -1,24 +1,96 @@
 #pragma once
 
 #include <vector>
-#include <random>
-#include <complex>
-#include "fftw-3.3/api/fftw3.h"
+#include <atomic>
+#include <cstdint>
+#include "SpectralNoiseShaper.h"
+#include "SpectralNoiseTransform.h"
 
+enum class RegenerationMode {
+	synchronous,
+	background,
+	amortized,
+};
+
+// renders every channel of the bus from one allocation, with a single transform per buffer
+// the transform holds the playing buffer and the next one, laid out as described there
 class SpectralNoiseSampler
 {
-	std::vector<float> _buffer;
-	std::vector<std::complex<float>> _fourrier_buffer;
-	fftwf_plan _fft_plan;
+	enum NextBufferState {
+		next_buffer_empty,
+		next_buffer_busy,
+		next_buffer_ready,
+	};
+
+	// buffers of the transform
+	static constexpr size_t playing_buffer = 0;
+	static constexpr size_t next_buffer = 1;
+
+	size_t _frame_size;
+	size_t _channels_count;
+	SpectralNoiseTransform _transform;
+	SpectralNoiseShaper _shaper;
+	float _output_rms;
+
+	// the next buffer is handed between the worker thread and the audio thread through _next_buffer_state
+	SpectralNoiseShaper _next_shaper;
+	std::atomic<unsigned int> _next_buffer_version;
+	std::atomic<uint64_t> _next_buffer_frame_index;
+	std::atomic<int> _next_buffer_state;
+	// frame of the random sequence the next rendered buffer holds, one past the playing one
+	std::atomic<uint64_t> _next_frame_index;
 
 	size_t _index;
-	float _db_per_octave;
+	unsigned int _buffer_version;
+	std::atomic<float> _db_per_octave;
+	std::atomic<uint64_t> _seed;
+	// channels draw consecutive streams from this one
+	std::atomic<uint32_t> _stream;
+	// bumped whenever the tilt or the seed changes, buffers rendered before are stale
+	std::atomic<unsigned int> _spectrum_version;
+	std::atomic<RegenerationMode> _regeneration_mode;
+
+	// amortized mode builds the next buffer on the audio thread, one slice of each stage per block
+	enum AmortizedStage {
+		stage_randomize,
+		stage_gains,
+		stage_measure,
+		stage_tilt,
+		stage_transform,
+	};
+	bool _is_amortizing;
+	AmortizedStage _amortized_stage;
+	size_t _amortized_position;
+	unsigned int _amortized_version;
+	uint64_t _amortized_frame_index;
+	uint64_t _amortized_seed;
+	uint32_t _amortized_stream;
+	float _amortized_db_per_octave;
+	// positions of the channel stages run over every channel's bins, one channel after the other
+	std::vector<float> _amortized_energies;
+
+	void render_buffer(size_t buffer, SpectralNoiseShaper& shaper, uint64_t frame_index);
+	bool is_next_buffer_current() const;
+	bool swap_next_buffer(bool is_wrapping);
+	void update_buffer();
+	void start_amortized_buffer();
 
 public:
 	SpectralNoiseSampler();
-	~SpectralNoiseSampler();
-	void set_buffer_size(size_t buffer_size);
+	// reproducible plans are planned apart from the wisdom, the same build gives bit identical output whatever was measured before, at some cost in speed
+	void set_buffer_size(size_t buffer_size, size_t channels_count, double sample_rate, bool is_reproducible);
+	size_t channels_count() const;
+	size_t frame_size() const;
+	SpectralNoiseTransform& transform();
+	void set_seed(uint64_t seed, uint32_t stream);
 	void set_db_per_octave(float db_per_octave);
+	void set_regeneration_mode(RegenerationMode regeneration_mode);
 	void resample_noise();
-	float next_sample();
+	void prepare_next_buffer();
+	void advance_next_buffer(size_t samples);
+	// channels past channels_count() are cleared
+	void render(float* const* channels, size_t channels_count, size_t count);
+	// called once per block instead of render while the output is silent, playback stays suspended
+	// only asks for the plan and gets the first buffer ready, so the next note starts on a ready frame
+	void idle(size_t samples);
 };
@@ -0,0 +1,106 @@
+#include "SpectralNoiseShaper.h"
+#include <cmath>
+
+SpectralNoiseShaper::SpectralNoiseShaper():
+	_frame_size(0),
+	_bin_frequency(1),
+	_gains_db_per_octave(0),
+	_are_gains_valid(false)
+{}
+
+void SpectralNoiseShaper::set_frame_size(size_t frame_size, double sample_rate) {
+    _frame_size = frame_size;
+    _bin_frequency = sample_rate / frame_size;
+    _gains.resize(bins_count());
+    _are_gains_valid = false;
+}
+
+void SpectralNoiseShaper::set_seed(uint64_t seed, uint32_t stream) {
+    _random.set_seed(seed, stream);
+}
+
+size_t SpectralNoiseShaper::bins_count() const {
+    return _frame_size / 2 + 1;
+}
+
+void SpectralNoiseShaper::fill(float* real, float* imaginary, float db_per_octave, uint64_t frame_index, float target_rms) {
+    randomize(real, imaginary, 0, bins_count(), frame_index);
+    tilt(real, imaginary, db_per_octave, target_rms);
+}
+
+void SpectralNoiseShaper::randomize(float* real, float* imaginary, size_t begin, size_t end, uint64_t frame_index) const {
+    // uniform spectral noise on the real and imaginary parts
+    _random.fill(real, imaginary, begin, end, frame_index);
+}
+
+void SpectralNoiseShaper::tilt(float* real, float* imaginary, float db_per_octave, float target_rms) {
+    if (!are_gains_valid(db_per_octave)) {
+        build_gains(db_per_octave, 0, bins_count());
+    }
+    auto const energy = tilted_energy(real, imaginary, 0, bins_count());
+    apply_gains(real, imaginary, normalization(energy, target_rms), 0, bins_count());
+}
+
+bool SpectralNoiseShaper::are_gains_valid(float db_per_octave) const {
+    return _are_gains_valid && _gains_db_per_octave == db_per_octave;
+}
+
+void SpectralNoiseShaper::build_gains(float db_per_octave, size_t begin, size_t end) {
+    if (begin == 0) {
+        _are_gains_valid = false;
+    }
+
+    // 10^(db_per_octave * log2(frequency / pivot) / 20) == (frequency / pivot)^exponent
+    auto const exponent = float(db_per_octave * std::log2(10.0) / 20.0);
+    for (size_t bin = begin; bin < end; ++bin) {
+        auto const frequency = bin * _bin_frequency;
+        auto const gain = frequency < high_pass_frequency ? 0.f : std::pow(float(frequency / pivot_frequency), exponent);
+        _gains[bin] = gain;
+    }
+
+    if (end == bins_count()) {
+        _gains_db_per_octave = db_per_octave;
+        _are_gains_valid = true;
+    }
+}
+
+float SpectralNoiseShaper::tilted_energy(float const* real, float const* imaginary, size_t begin, size_t end) const {
+    auto const* gains = _gains.data();
+    float energy = 0;
+    for (size_t bin = begin; bin < end; ++bin) {
+        auto const gain = gains[bin];
+        energy += (real[bin] * real[bin] + imaginary[bin] * imaginary[bin]) * gain * gain;
+    }
+    // every bin also stands for its mirror image in the full spectrum, except dc and nyquist
+    // whose imaginary parts the real inverse transform ignores
+    energy *= 2;
+    for (auto const bin : { size_t(0), _frame_size / 2 }) {
+        if (bin >= begin && bin < end) {
+            auto const gain = gains[bin];
+            energy -= (real[bin] * real[bin] + 2 * imaginary[bin] * imaginary[bin]) * gain * gain;
+        }
+    }
+    return energy;
+}
+
+void SpectralNoiseShaper::apply_gains(float* real, float* imaginary, float factor, size_t begin, size_t end) const {
+    auto const* gains = _gains.data();
+    for (size_t bin = begin; bin < end; ++bin) {
+        auto const gain = gains[bin] * factor;
+        real[bin] *= gain;
+        imaginary[bin] *= gain;
+    }
+}
+
+// the unnormalized inverse transform of a spectrum of energy e has a mean square of e
+float SpectralNoiseShaper::normalization(float energy, float target_rms) {
+    return target_rms / std::sqrt(energy);
+}
+
+float SpectralNoiseShaper::output_rms(double sample_rate) {
+    return 64 / std::sqrt(float(std::ceil(sample_rate)));
+}
+
+double SpectralNoiseShaper::min_frame_duration() {
+    return 2 / high_pass_frequency;
+}
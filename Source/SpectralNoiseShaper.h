@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "SpectralNoiseRandom.h"
+
+// builds the tilted random spectrum shared by the noise engines
+// spectra are split, the real and imaginary parts of the bins are in separate arrays
+// every step also works on a range, so a frame can be built a slice at a time
+// the shape is defined in hertz, the frame size only sets how finely it is sampled
+class SpectralNoiseShaper
+{
+public:
+	// bins below the corner are silent
+	static constexpr double high_pass_frequency = 20;
+	// the tilt leaves this frequency at unit gain
+	static constexpr double pivot_frequency = 1000;
+
+private:
+	size_t _frame_size;
+	double _bin_frequency;
+	SpectralNoiseRandom _random;
+
+	// per bin gain of the tilt, applied to both parts as a plain float multiply
+	std::vector<float> _gains;
+	float _gains_db_per_octave;
+	bool _are_gains_valid;
+
+public:
+	SpectralNoiseShaper();
+	// bins are mapped to hertz from both, any even frame size gives the same tilt
+	void set_frame_size(size_t frame_size, double sample_rate);
+	// shapers with the same seed and stream produce the same frames
+	void set_seed(uint64_t seed, uint32_t stream);
+	size_t bins_count() const;
+
+	// fills bins_count() bins with the random spectrum of frame_index
+	// the spectrum is normalized so its inverse transform comes out at target_rms, with no pass over the samples
+	void fill(float* real, float* imaginary, float db_per_octave, uint64_t frame_index, float target_rms);
+	void randomize(float* real, float* imaginary, size_t begin, size_t end, uint64_t frame_index) const;
+	void tilt(float* real, float* imaginary, float db_per_octave, float target_rms);
+
+	// the gain table is only rebuilt when the tilt or the frame size change
+	bool are_gains_valid(float db_per_octave) const;
+	// the table is valid once every bin has been built, in order
+	void build_gains(float db_per_octave, size_t begin, size_t end);
+	// energy the bins will have once tilted, by parseval the square of the rms of the unnormalized inverse transform
+	float tilted_energy(float const* real, float const* imaginary, size_t begin, size_t end) const;
+	void apply_gains(float* real, float* imaginary, float factor, size_t begin, size_t end) const;
+	static float normalization(float energy, float target_rms);
+
+	// level of the engines' output, the one the original one second frames were normalized to
+	static float output_rms(double sample_rate);
+	// shortest frame with two bins below the high-pass corner, shorter ones blur it
+	static double min_frame_duration();
+};
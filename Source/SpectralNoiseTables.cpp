@@ -0,0 +1,171 @@
+#include "SpectralNoiseTables.h"
+#include <cmath>
+#include <algorithm>
+
+// samples kept before and after each level for the interpolator
+static constexpr size_t leading_samples = SpectralNoiseTables::taps / 2 - 1;
+static constexpr size_t trailing_samples = SpectralNoiseTables::taps / 2;
+// the half-band filter spans 4 * half_band_zeros - 1 samples
+static constexpr size_t half_band_zeros = 8;
+
+static double sinc(double x) {
+    auto const pi = std::acos(-1.0);
+    return x == 0 ? 1.0 : std::sin(pi * x) / (pi * x);
+}
+
+// 4 term blackman-harris, x from -1 to 1
+static double window(double x) {
+    auto const pi = std::acos(-1.0);
+    auto const phase = pi * (x + 1);
+    return 0.35875 - 0.48829 * std::cos(phase) + 0.14128 * std::cos(2 * phase) - 0.01168 * std::cos(3 * phase);
+}
+
+// windowed sinc filters, the interpolator's cutoff goes from nyquist to half of it
+// normalized to unit gain at dc
+static std::vector<float> make_phases() {
+    using Tables = SpectralNoiseTables;
+    std::vector<float> phases((Tables::cutoffs_count + 1) * (Tables::phases_count + 1) * Tables::taps);
+    for (size_t cutoff = 0; cutoff <= Tables::cutoffs_count; ++cutoff) {
+        auto const frequency = 1.0 / (1.0 + double(cutoff) / Tables::cutoffs_count);
+        for (size_t phase = 0; phase <= Tables::phases_count; ++phase) {
+            auto* const coefficients = phases.data() + (cutoff * (Tables::phases_count + 1) + phase) * Tables::taps;
+            double sum = 0;
+            for (size_t tap = 0; tap < Tables::taps; ++tap) {
+                auto const distance = double(tap) - double(leading_samples) - double(phase) / Tables::phases_count;
+                auto const coefficient = sinc(frequency * distance) * window(distance / trailing_samples);
+                coefficients[tap] = float(coefficient);
+                sum += coefficient;
+            }
+            for (size_t tap = 0; tap < Tables::taps; ++tap) {
+                coefficients[tap] = float(coefficients[tap] / sum);
+            }
+        }
+    }
+    return phases;
+}
+
+// the same for every table, built by the first one
+static std::vector<float> const& phases() {
+    static std::vector<float> const phases = make_phases();
+    return phases;
+}
+
+// the half-band filter is a windowed sinc at half of nyquist, normalized to unit gain at dc
+SpectralNoiseTables::SpectralNoiseTables():
+	_frame_size(0),
+	_channels_count(0),
+	_phases(phases().data()),
+	_half_band_center(0)
+{
+    auto const half_band_radius = double(2 * half_band_zeros);
+    _half_band.resize(half_band_zeros);
+    double sum = 0.5;
+    for (size_t i = 0; i < half_band_zeros; ++i) {
+        auto const distance = double(2 * i + 1);
+        auto const coefficient = 0.5 * sinc(distance / 2) * window(distance / half_band_radius);
+        _half_band[i] = float(coefficient);
+        sum += 2 * coefficient;
+    }
+    for (auto& coefficient : _half_band) {
+        coefficient = float(coefficient / sum);
+    }
+    _half_band_center = float(0.5 / sum);
+}
+
+void SpectralNoiseTables::prepare(size_t frame_size, size_t channels_count) {
+    _frame_size = frame_size;
+    _channels_count = channels_count;
+    _levels.resize(channels_count * levels_count);
+    for (size_t channel = 0; channel < channels_count; ++channel) {
+        for (size_t level = 0; level < levels_count; ++level) {
+            _levels[channel * levels_count + level].assign(leading_samples + (frame_size >> level) + trailing_samples, 0.f);
+        }
+    }
+}
+
+void SpectralNoiseTables::build(size_t channel, size_t level, float const* frame, size_t begin, size_t end) {
+    if (channel >= _channels_count) {
+        return;
+    }
+    auto* const levels = _levels.data() + channel * levels_count;
+    auto const level_size = _frame_size >> level;
+    if (level == 0) {
+        std::copy(frame + begin, frame + end, levels[0].data() + leading_samples + begin);
+    }
+    else {
+        decimate(levels[level - 1], level_size * 2, levels[level], begin, end);
+    }
+    if (end == level_size) {
+        wrap(levels[level], level_size);
+    }
+}
+
+// the frame is periodic, the filter wraps around the level instead of running into its edges
+// only the outputs from begin to end are written
+void SpectralNoiseTables::decimate(std::vector<float> const& level, size_t level_size, std::vector<float>& decimated, size_t begin, size_t end) const {
+    auto const* const samples = level.data() + leading_samples;
+    auto const sample = [samples, level_size](ptrdiff_t index) {
+        index %= ptrdiff_t(level_size);
+        return samples[index < 0 ? index + ptrdiff_t(level_size) : index];
+    };
+
+    auto const radius = ptrdiff_t(2 * half_band_zeros - 1);
+    auto* const output = decimated.data() + leading_samples;
+    for (size_t i = begin; i < end; ++i) {
+        auto const center = ptrdiff_t(2 * i);
+        auto value = _half_band_center * samples[center];
+        // away from the edges the reads never wrap
+        if (center >= radius && center + radius < ptrdiff_t(level_size)) {
+            for (size_t tap = 0; tap < half_band_zeros; ++tap) {
+                auto const offset = ptrdiff_t(2 * tap + 1);
+                value += _half_band[tap] * (samples[center - offset] + samples[center + offset]);
+            }
+        }
+        else {
+            for (size_t tap = 0; tap < half_band_zeros; ++tap) {
+                auto const offset = ptrdiff_t(2 * tap + 1);
+                value += _half_band[tap] * (sample(center - offset) + sample(center + offset));
+            }
+        }
+        output[i] = value;
+    }
+}
+
+// the top levels can be shorter than the samples read past their edges, those wrap more than once
+void SpectralNoiseTables::wrap(std::vector<float>& level, size_t level_size) const {
+    auto* const samples = level.data() + leading_samples;
+    for (size_t i = 0; i < leading_samples; ++i) {
+        level[i] = samples[(level_size - (leading_samples - i) % level_size) % level_size];
+    }
+    for (size_t i = 0; i < trailing_samples; ++i) {
+        samples[level_size + i] = samples[i % level_size];
+    }
+}
+
+size_t SpectralNoiseTables::frame_size() const {
+    return _frame_size;
+}
+
+size_t SpectralNoiseTables::channels_count() const {
+    return _channels_count;
+}
+
+size_t SpectralNoiseTables::level(double rate) {
+    auto const level = rate > 1 ? size_t(std::floor(std::log2(rate))) : size_t(0);
+    return std::min(level, levels_count - 1);
+}
+
+// rounded up, a lower cutoff than the step needs dulls the top of the band, a higher one aliases
+size_t SpectralNoiseTables::cutoff(double rate) {
+    auto const step = rate / std::ldexp(1.0, int(level(rate)));
+    auto const cutoff = step > 1 ? size_t(std::ceil((step - 1) * cutoffs_count - 1e-9)) : size_t(0);
+    return std::min(cutoff, cutoffs_count);
+}
+
+float const* SpectralNoiseTables::samples(size_t channel, size_t level, size_t index) const {
+    return _levels[channel * levels_count + level].data() + index;
+}
+
+float const* SpectralNoiseTables::coefficients(size_t cutoff, float fraction) const {
+    return _phases + (cutoff * (phases_count + 1) + size_t(fraction * phases_count + 0.5f)) * taps;
+}
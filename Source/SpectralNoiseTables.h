@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// band-limited copies of a periodic noise frame, each level half as long as the one above, read through a polyphase interpolator
+// a rate reads the level it steps through at one to two samples per output sample
+// the interpolator's cutoff drops as the step grows, so the output stays below nyquist without losing a whole octave
+// levels wrap around, every one starts and ends with the samples the interpolator reads past its edges
+class SpectralNoiseTables
+{
+public:
+	// level l holds frame_size >> l samples, frame sizes must be multiples of 1 << (levels_count - 1)
+	// a frame of one period of midi note 0 reads the top level for the highest notes
+	static constexpr size_t levels_count = 11;
+	// samples read around a position, from taps / 2 - 1 before it to taps / 2 after it
+	static constexpr size_t taps = 8;
+	// fractions of a sample are rounded to this many phases
+	static constexpr size_t phases_count = 256;
+	// steps from 1 to 2 samples are rounded up to this many cutoffs, from nyquist down to half of it
+	static constexpr size_t cutoffs_count = 8;
+
+private:
+	size_t _frame_size;
+	size_t _channels_count;
+	// channel c, level l at c * levels_count + l, its sample i at taps / 2 - 1 + i
+	std::vector<std::vector<float>> _levels;
+	// taps coefficients for each phase from 0 to phases_count included, for each cutoff from 0 to cutoffs_count included
+	// shared by every table
+	float const* _phases;
+	// odd half of the half-band decimation filter, the even taps past the center are zero
+	std::vector<float> _half_band;
+	float _half_band_center;
+
+	void decimate(std::vector<float> const& level, size_t level_size, std::vector<float>& decimated, size_t begin, size_t end) const;
+	void wrap(std::vector<float>& level, size_t level_size) const;
+
+public:
+	SpectralNoiseTables();
+	// allocates every level, builds never do
+	void prepare(size_t frame_size, size_t channels_count);
+	// level 0 is copied from the frame, every other level is decimated from the one above, which is built first
+	// the frame is only read for level 0, a level costs about as much as the one above it, halved
+	// builds the samples from begin to end of the level, it is wrapped once its last sample is built
+	void build(size_t channel, size_t level, float const* frame, size_t begin, size_t end);
+	size_t frame_size() const;
+	size_t channels_count() const;
+	// the highest level read at least one sample per output sample at this rate, and the cutoff of that step
+	static size_t level(double rate);
+	static size_t cutoff(double rate);
+	// taps samples ending taps / 2 after index, of level l
+	float const* samples(size_t channel, size_t level, size_t index) const;
+	// taps coefficients for a fraction of a sample in [0, 1]
+	float const* coefficients(size_t cutoff, float fraction) const;
+};
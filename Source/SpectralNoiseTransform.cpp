@@ -0,0 +1,310 @@
+#include "SpectralNoiseTransform.h"
+#include <cmath>
+#include <utility>
+#include <algorithm>
+#include "SpectralNoisePlanner.h"
+
+SpectralNoiseTransform::SpectralNoiseTransform():
+	_size(0),
+	_channels_count(0),
+	_frame_stride(0),
+	_bins_stride(0),
+	_imaginary_offset(0),
+	_plan(nullptr),
+	_estimated_plan(nullptr),
+	_plan_generation(0),
+	_is_reproducible(false),
+	_is_plan_wanted(false),
+	_is_plan_requested(false),
+	_execution(TransformExecution::whole),
+	_columns_count(0),
+	_rows_count(0),
+	_columns_plan(nullptr),
+	_rows_plan(nullptr),
+	_is_stepping(false),
+	_step_buffer(0),
+	_step_channel(0),
+	_step_stage(step_pack),
+	_step_position(0)
+{}
+
+SpectralNoiseTransform::~SpectralNoiseTransform() {
+    SpectralNoisePlanner::cancel(this);
+    release_plans();
+}
+
+void SpectralNoiseTransform::release_plans() {
+    auto const estimated_plan = _estimated_plan.load();
+    if (estimated_plan != _plan.load()) {
+        SpectralNoisePlanner::release(estimated_plan);
+    }
+    SpectralNoisePlanner::release(_plan.load());
+    SpectralNoisePlanner::release(_columns_plan.load());
+    SpectralNoisePlanner::release(_rows_plan.load());
+    _plan = nullptr;
+    _estimated_plan = nullptr;
+    _columns_plan = nullptr;
+    _rows_plan = nullptr;
+}
+
+void SpectralNoiseTransform::set_size(size_t size, size_t channels_count, size_t buffers_count, bool is_reproducible, TransformExecution execution) {
+    SpectralNoisePlanner::cancel(this);
+    release_plans();
+    _size = size;
+    _channels_count = channels_count;
+    _frame_stride = SpectralNoisePlanner::channel_stride(size);
+    _bins_stride = SpectralNoisePlanner::channel_stride(size/2 + 1);
+    _imaginary_offset = SpectralNoisePlanner::imaginary_offset(size, channels_count);
+    _buffers.resize(buffers_count);
+    for (auto& buffer : _buffers) {
+        buffer.assign(SpectralNoisePlanner::transform_size(size, channels_count), 0.f);
+    }
+    _is_reproducible = is_reproducible;
+    _is_plan_wanted = false;
+    _is_plan_requested = false;
+
+    // the columns are about as long as the rows, each step is a short transform
+    _execution = execution;
+    _is_stepping = false;
+    auto const half_size = size / 2;
+    if (execution == TransformExecution::whole || half_size == 0) {
+        _columns_count = 0;
+        _rows_count = 0;
+        _steps = AlignedFloats();
+        _twiddle_real = std::vector<float>();
+        _twiddle_imaginary = std::vector<float>();
+        return;
+    }
+    _columns_count = 1;
+    for (size_t divisor = 1; divisor * divisor <= half_size; ++divisor) {
+        if (half_size % divisor == 0) {
+            _columns_count = divisor;
+        }
+    }
+    _rows_count = half_size / _columns_count;
+    _steps.assign(2 * half_size, 0.f);
+    _twiddle_real.resize(half_size);
+    _twiddle_imaginary.resize(half_size);
+    auto const pi = std::acos(-1.0);
+    for (size_t index = 0; index < half_size; ++index) {
+        auto const phase = 2 * pi * double(index) / double(size);
+        _twiddle_real[index] = float(std::cos(phase));
+        _twiddle_imaginary[index] = float(std::sin(phase));
+    }
+}
+
+size_t SpectralNoiseTransform::size() const {
+    return _size;
+}
+
+size_t SpectralNoiseTransform::channels_count() const {
+    return _channels_count;
+}
+
+bool SpectralNoiseTransform::is_empty() const {
+    return _buffers.empty() || _buffers[0].empty();
+}
+
+bool SpectralNoiseTransform::is_planned() const {
+    auto const is_whole_planned = _plan.load(std::memory_order_relaxed) != nullptr;
+    auto const is_stepped_planned = _columns_plan.load(std::memory_order_relaxed) != nullptr && _rows_plan.load(std::memory_order_relaxed) != nullptr;
+    switch (_execution) {
+        case TransformExecution::whole:
+            return is_whole_planned;
+        case TransformExecution::stepped:
+            return is_stepped_planned;
+        case TransformExecution::both:
+            return is_whole_planned && is_stepped_planned;
+    }
+    return false;
+}
+
+bool SpectralNoiseTransform::want_plan() {
+    if (is_planned()) {
+        return true;
+    }
+    _is_plan_wanted.store(true, std::memory_order_relaxed);
+    return false;
+}
+
+bool SpectralNoiseTransform::is_plan_wanted() const {
+    return _is_plan_wanted.load() && !_is_plan_requested;
+}
+
+// the planner's plan runs on every buffer through the new-array execute interface
+// an estimated plan is upgraded once a measurement finishes after this point
+// the plans of the steps run on every column and row, the columns in place in the scratch arrays
+// the rows write every other sample, from the scratch arrays to the buffer, as a complex transform of half the size does
+void SpectralNoiseTransform::request_plan() {
+    if (_is_plan_requested || is_empty()) {
+        return;
+    }
+    _is_plan_requested = true;
+
+    if (_execution != TransformExecution::whole) {
+        auto const columns_count = int(_columns_count);
+        auto const rows_count = int(_rows_count);
+        auto const half_size = int(_size / 2);
+        SpectralNoisePlanner::request_split_dft(this, rows_count, columns_count, columns_count, half_size, half_size, [this](fftwf_plan plan, bool) {
+            _columns_plan = plan;
+        });
+        SpectralNoisePlanner::request_split_dft(this, columns_count, 1, 2 * rows_count, half_size, 1, [this](fftwf_plan plan, bool) {
+            _rows_plan = plan;
+        });
+    }
+    if (_execution == TransformExecution::stepped) {
+        return;
+    }
+
+    auto const is_reproducible = _is_reproducible;
+    _plan_generation = SpectralNoisePlanner::wisdom_generation();
+    SpectralNoisePlanner::request_c2r(this, int(_size), int(_channels_count), is_reproducible, [this, is_reproducible](fftwf_plan plan, bool is_estimated) {
+        _estimated_plan = is_estimated && !is_reproducible ? plan : nullptr;
+        _plan = plan;
+    });
+}
+
+void SpectralNoiseTransform::upgrade_plan() {
+    auto const estimated_plan = _estimated_plan.load();
+    if (!estimated_plan || _plan.load() != estimated_plan) {
+        return;
+    }
+    auto const generation = SpectralNoisePlanner::wisdom_generation();
+    if (generation == _plan_generation) {
+        return;
+    }
+    _plan_generation = generation;
+
+    SpectralNoisePlanner::request_c2r_from_wisdom(this, int(_size), int(_channels_count), [this](fftwf_plan plan, bool) {
+        if (plan) {
+            _plan = plan;
+        }
+    });
+}
+
+float* SpectralNoiseTransform::real(size_t buffer, size_t channel) {
+    return _buffers[buffer].data() + channel * _bins_stride;
+}
+
+float* SpectralNoiseTransform::imaginary(size_t buffer, size_t channel) {
+    return _buffers[buffer].data() + _imaginary_offset + channel * _bins_stride;
+}
+
+float const* SpectralNoiseTransform::samples(size_t buffer, size_t channel) const {
+    return _buffers[buffer].data() + channel * _frame_stride;
+}
+
+void SpectralNoiseTransform::swap_buffers(size_t first, size_t second) {
+    std::swap(_buffers[first], _buffers[second]);
+}
+
+void SpectralNoiseTransform::execute(size_t buffer) {
+    auto* const data = _buffers[buffer].data();
+    fftwf_execute_split_dft_c2r(_plan.load(), data, data + _imaginary_offset, data);
+}
+
+// packing, the columns and the rows each take about half the size of a channel
+size_t SpectralNoiseTransform::steps_work() const {
+    return 2 * _size * _channels_count;
+}
+
+void SpectralNoiseTransform::start_steps(size_t buffer) {
+    _is_stepping = true;
+    _step_buffer = buffer;
+    _step_channel = _channels_count - 1;
+    _step_stage = step_pack;
+    _step_position = 0;
+}
+
+bool SpectralNoiseTransform::is_stepping() const {
+    return _is_stepping;
+}
+
+size_t SpectralNoiseTransform::run_steps(size_t budget) {
+    size_t work = 0;
+    while (_is_stepping && work < budget) {
+        work += run_step(budget - work);
+    }
+    return work;
+}
+
+// runs a slice of packing, a column or a row, returns its work
+// the bins are packed as z[k] = x[k] + conj(x[h - k]) + i (x[k] - conj(x[h - k])) w^k, with h half the size and w its root of unity
+// the inverse of z holds the even samples in its real parts, the odd ones in its imaginary parts
+// the imaginary parts of the first and last bins are ignored, as by the c2r plans
+size_t SpectralNoiseTransform::run_step(size_t budget) {
+    auto const half_size = _size / 2;
+    auto* const step_real = _steps.data();
+    auto* const step_imaginary = step_real + half_size;
+    switch (_step_stage) {
+        case step_pack: {
+            auto const* const real = this->real(_step_buffer, _step_channel);
+            auto const* const imaginary = this->imaginary(_step_buffer, _step_channel);
+            auto const end = std::min(half_size, _step_position + budget);
+            for (auto bin = _step_position; bin < end; ++bin) {
+                auto const mirror = half_size - bin;
+                auto const bin_imaginary = bin == 0 ? 0.f : imaginary[bin];
+                auto const mirror_imaginary = bin == 0 ? 0.f : imaginary[mirror];
+                auto const even_real = real[bin] + real[mirror];
+                auto const even_imaginary = bin_imaginary - mirror_imaginary;
+                auto const difference_real = real[bin] - real[mirror];
+                auto const difference_imaginary = bin_imaginary + mirror_imaginary;
+                auto const odd_real = difference_real * _twiddle_real[bin] - difference_imaginary * _twiddle_imaginary[bin];
+                auto const odd_imaginary = difference_real * _twiddle_imaginary[bin] + difference_imaginary * _twiddle_real[bin];
+                step_real[bin] = even_real - odd_imaginary;
+                step_imaginary[bin] = even_imaginary + odd_real;
+            }
+            auto const work = end - _step_position;
+            _step_position = end;
+            if (end == half_size) {
+                _step_stage = step_columns;
+                _step_position = 0;
+            }
+            return work;
+        }
+        case step_columns: {
+            // backward, through the forward plan with the parts swapped
+            auto const column = _step_position;
+            fftwf_execute_split_dft(_columns_plan.load(), step_imaginary + column, step_real + column, step_imaginary + column, step_real + column);
+            if (++_step_position == _columns_count) {
+                _step_stage = step_rows;
+                _step_position = 0;
+            }
+            return _rows_count;
+        }
+        case step_rows: {
+            // row r is twiddled by w^(2 c r) at column c, before its transform
+            auto const row = _step_position;
+            auto* const row_real = step_real + row * _columns_count;
+            auto* const row_imaginary = step_imaginary + row * _columns_count;
+            size_t twiddle = 0;
+            for (size_t column = 0; column < _columns_count; ++column) {
+                auto const is_opposite = twiddle >= half_size;
+                auto const twiddle_real = is_opposite ? -_twiddle_real[twiddle - half_size] : _twiddle_real[twiddle];
+                auto const twiddle_imaginary = is_opposite ? -_twiddle_imaginary[twiddle - half_size] : _twiddle_imaginary[twiddle];
+                auto const value_real = row_real[column];
+                auto const value_imaginary = row_imaginary[column];
+                row_real[column] = value_real * twiddle_real - value_imaginary * twiddle_imaginary;
+                row_imaginary[column] = value_real * twiddle_imaginary + value_imaginary * twiddle_real;
+                twiddle += 2 * row;
+                if (twiddle >= _size) {
+                    twiddle -= _size;
+                }
+            }
+            auto* const samples = _buffers[_step_buffer].data() + _step_channel * _frame_stride + 2 * row;
+            fftwf_execute_split_dft(_rows_plan.load(), row_imaginary, row_real, samples + 1, samples);
+            if (++_step_position == _rows_count) {
+                if (_step_channel == 0) {
+                    _is_stepping = false;
+                }
+                else {
+                    --_step_channel;
+                    _step_stage = step_pack;
+                    _step_position = 0;
+                }
+            }
+            return 2 * _columns_count;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include "fftw-3.3/api/fftw3.h"
+#include "SpectralNoiseAllocator.h"
+
+// how a transform runs, whole through its c2r plan, in steps short enough for a block of the audio thread, or both
+enum class TransformExecution {
+	whole,
+	stepped,
+	both,
+};
+
+// the inverse transform of a noise engine, the buffers it runs on and the shared plan it runs with
+// transforms are in place, a buffer holds the real parts of the bins until it is transformed
+// the imaginary parts follow the samples of every channel, at _imaginary_offset
+// channel c of a buffer starts at c * _frame_stride, of either part of the bins at c * _bins_stride
+// a stepped transform runs the same inverse as a complex one of half the size, in four steps with rows * columns = size / 2
+// the bins are packed into the scratch arrays, the columns transformed in place, then each row twiddled and transformed into the samples
+// channels are stepped from the last, the samples of a channel only overwrite the bins of itself and of the channels after it
+class SpectralNoiseTransform
+{
+	enum StepStage {
+		step_pack,
+		step_columns,
+		step_rows,
+	};
+
+	size_t _size;
+	size_t _channels_count;
+	size_t _frame_stride;
+	size_t _bins_stride;
+	size_t _imaginary_offset;
+	std::vector<AlignedFloats> _buffers;
+	// shared with the other transforms, null until the planner delivers it
+	// an estimated plan may still be running on the audio thread once it is upgraded, it is only released with the next size
+	std::atomic<fftwf_plan> _plan;
+	std::atomic<fftwf_plan> _estimated_plan;
+	unsigned int _plan_generation;
+	bool _is_reproducible;
+	// nothing is planned until the engine first needs the plan, hosts scanning or loading plugins never pay for it
+	std::atomic<bool> _is_plan_wanted;
+	bool _is_plan_requested;
+
+	TransformExecution _execution;
+	// each column holds _rows_count bins of the packed complex transform, each row _columns_count
+	size_t _columns_count;
+	size_t _rows_count;
+	std::atomic<fftwf_plan> _columns_plan;
+	std::atomic<fftwf_plan> _rows_plan;
+	// the real parts of the packed bins, then their imaginary parts
+	AlignedFloats _steps;
+	// powers of the size's root of unity, from 0 to size / 2, the other half is their opposite
+	std::vector<float> _twiddle_real;
+	std::vector<float> _twiddle_imaginary;
+	bool _is_stepping;
+	size_t _step_buffer;
+	size_t _step_channel;
+	StepStage _step_stage;
+	size_t _step_position;
+
+	void release_plans();
+	size_t run_step(size_t budget);
+
+public:
+	SpectralNoiseTransform();
+	~SpectralNoiseTransform();
+	// clears every buffer, the plan of the previous size is dropped
+	// reproducible plans are planned apart from the wisdom, the same build gives bit identical output whatever was measured before, at some cost in speed
+	// stepped transforms need a size whose half isn't prime, or they take a single column step
+	void set_size(size_t size, size_t channels_count, size_t buffers_count, bool is_reproducible, TransformExecution execution);
+	size_t size() const;
+	size_t channels_count() const;
+	bool is_empty() const;
+
+	bool is_planned() const;
+	// every plan of the execution has arrived
+	// called where the plan is needed, from the audio thread too, asks for it if it hasn't arrived
+	bool want_plan();
+	// called off the audio thread, by the worker, or by prepareToPlay when there is none
+	bool is_plan_wanted() const;
+	void request_plan();
+	// replaces an estimated plan once the planning thread has measured its size
+	void upgrade_plan();
+
+	float* real(size_t buffer, size_t channel);
+	float* imaginary(size_t buffer, size_t channel);
+	float const* samples(size_t buffer, size_t channel) const;
+	void swap_buffers(size_t first, size_t second);
+	// the plan must have arrived, every channel of the buffer is transformed at once
+	void execute(size_t buffer);
+
+	// a stepped transform of a buffer, about twice its size in work, over every channel
+	size_t steps_work() const;
+	// starts over, a transform in steps left unfinished is dropped
+	void start_steps(size_t buffer);
+	bool is_stepping() const;
+	// runs steps until their work reaches the budget, or the transform is complete, and returns their work
+	// a step is a column or a row, at least one runs
+	size_t run_steps(size_t budget);
+};
@@ -0,0 +1,267 @@
+#include "SpectralNoiseVoices.h"
+#include <cmath>
+#include <algorithm>
+
+static_assert(SpectralNoiseVoices::max_unison % SpectralNoiseHeads::max_lanes == 0, "a voice's heads fill whole registers");
+static_assert(SpectralNoiseColours::colours_count >= 2, "voices crossfade pairs of colours");
+
+SpectralNoiseVoices::SpectralNoiseVoices():
+	_shape(SpectralNoiseEnvelope::Shape::from_times(0, 0, 1, 0, 44100)),
+	_frame_size(0),
+	_frame_frequency(1),
+	_notes_started(0),
+	_unison(1),
+	_detune_cents(0),
+	_db_per_octave(0),
+	_expression_db_per_octave(0),
+	_kernel(&SpectralNoiseHeads::kernel())
+{
+    _channel_expressions.fill(0.f);
+}
+
+void SpectralNoiseVoices::prepare(size_t voices_count, size_t frame_size, double sample_rate) {
+    _voices.assign(voices_count, Voice { 0, -1, false, 0, 0.f, 0, SpectralNoiseEnvelope(), 0.f, 0.f });
+    _envelope_gains.assign(voices_count * chunk_size, 0.f);
+    _chunk_voices.clear();
+    _chunk_voices.reserve(voices_count);
+    _frame_size = frame_size;
+    _frame_frequency = frame_size > 0 ? sample_rate / double(frame_size) : 1.0;
+    _notes_started = 0;
+    auto const heads_count = voices_count * max_unison;
+    _head_indices.assign(heads_count, 0.f);
+    _head_fractions.assign(heads_count, 0.f);
+    _head_index_steps.assign(heads_count, 0.f);
+    _head_fraction_steps.assign(heads_count, 0.f);
+    _head_levels.assign(heads_count, 0);
+    _head_cutoffs.assign(heads_count, 0);
+    _head_level_scales.assign(heads_count, 1.f);
+    _head_sums.assign(chunk_size * SpectralNoiseHeads::max_lanes, 0.f);
+}
+
+double SpectralNoiseVoices::frame_duration() {
+    return 1 / lowest_frequency;
+}
+
+void SpectralNoiseVoices::set_unison(size_t unison, float detune_cents) {
+    _unison = std::min(std::max(unison, size_t(1)), max_unison);
+    if (detune_cents == _detune_cents) {
+        return;
+    }
+    _detune_cents = detune_cents;
+    for (size_t voice_index = 0; voice_index < _voices.size(); ++voice_index) {
+        if (_voices[voice_index].envelope.is_active()) {
+            set_head_rates(_voices[voice_index], voice_index);
+        }
+    }
+}
+
+void SpectralNoiseVoices::set_envelope(SpectralNoiseEnvelope::Shape const& shape) {
+    _shape = shape;
+}
+
+void SpectralNoiseVoices::set_tilt(float db_per_octave, float expression_db_per_octave) {
+    _db_per_octave = db_per_octave;
+    _expression_db_per_octave = expression_db_per_octave;
+}
+
+void SpectralNoiseVoices::set_head_rates(Voice const& voice, size_t voice_index) {
+    auto const first_head = voice_index * max_unison;
+    for (size_t head = 0; head < voice.heads_count; ++head) {
+        auto const spread = voice.heads_count > 1 ? 2.0 * head / (voice.heads_count - 1) - 1.0 : 0.0;
+        auto const frequency = 440.0 * std::exp2((voice.note - 69) / 12.0 + spread * _detune_cents / 1200.0);
+        auto const rate = frequency / _frame_frequency;
+        auto const index_step = std::floor(rate);
+        auto const level = SpectralNoiseTables::level(rate);
+        _head_index_steps[first_head + head] = float(index_step);
+        _head_fraction_steps[first_head + head] = float(rate - index_step);
+        _head_levels[first_head + head] = level;
+        _head_cutoffs[first_head + head] = SpectralNoiseTables::cutoff(rate);
+        _head_level_scales[first_head + head] = std::ldexp(1.f, -int(level));
+    }
+}
+
+float SpectralNoiseVoices::target_colour(Voice const& voice) const {
+    return SpectralNoiseColours::colour(_db_per_octave + _expression_db_per_octave * voice.expression);
+}
+
+// the colour moves to the voice's tilt over the chunk, but stops at the next colour, so it reads a single pair
+// a colour is both the end of one pair and the start of the next, the following chunk carries on from there
+SpectralNoiseVoices::ChunkVoice SpectralNoiseVoices::move_colour(Voice& voice, size_t voice_index, size_t count) const {
+    auto const from = voice.colour;
+    auto const target = target_colour(voice);
+    size_t colour;
+    float to;
+    if (target < from) {
+        colour = size_t(std::max(std::ceil(from) - 1.f, 0.f));
+        to = std::max(target, float(colour));
+    }
+    else {
+        colour = std::min(size_t(from), SpectralNoiseColours::colours_count - 2);
+        to = std::min(target, float(colour + 1));
+    }
+    voice.colour = to;
+    return ChunkVoice { voice_index, colour, from - float(colour), (to - from) / float(count) };
+}
+
+// a free voice is taken if there is one, the oldest released voice or the oldest voice otherwise
+// a stolen voice's envelope restarts from its current level, its colour jumps to the new note's with its heads
+// heads start at scattered positions of the frame, so they don't play in phase
+void SpectralNoiseVoices::note_on(int channel, int note, float velocity) {
+    if (_voices.empty() || _frame_size == 0) {
+        return;
+    }
+
+    auto voice = std::find_if(_voices.begin(), _voices.end(), [](Voice const& voice) {
+        return !voice.envelope.is_active();
+    });
+    if (voice == _voices.end()) {
+        voice = std::min_element(_voices.begin(), _voices.end(), [](Voice const& a, Voice const& b) {
+            if (a.is_held != b.is_held) {
+                return !a.is_held;
+            }
+            return a.start_index < b.start_index;
+        });
+    }
+    auto const voice_index = size_t(voice - _voices.begin());
+    voice->channel = channel;
+    voice->note = note;
+    voice->is_held = true;
+    voice->expression = channel >= 1 && channel <= int(midi_channels_count) ? _channel_expressions[size_t(channel - 1)] : 0.f;
+    voice->colour = target_colour(*voice);
+    voice->envelope.note_on(velocity);
+    voice->heads_count = _unison;
+    voice->gain = 1.f / std::sqrt(float(_unison));
+    voice->start_index = _notes_started++;
+    set_head_rates(*voice, voice_index);
+
+    // golden ratio increments spread the starts evenly, and the same notes start at the same positions every run
+    auto const golden_ratio_fraction = 0.6180339887498949;
+    auto const first_head = voice_index * max_unison;
+    for (size_t head = 0; head < max_unison; ++head) {
+        auto const sequence_index = voice->start_index * max_unison + head;
+        auto const position = std::fmod(sequence_index * golden_ratio_fraction, 1.0) * _frame_size;
+        auto const index = std::min(std::floor(position), double(_frame_size - 1));
+        _head_indices[first_head + head] = float(index);
+        _head_fractions[first_head + head] = float(position - index);
+    }
+}
+
+void SpectralNoiseVoices::note_off(int channel, int note) {
+    for (auto& voice : _voices) {
+        if (voice.is_held && voice.channel == channel && voice.note == note) {
+            voice.is_held = false;
+            voice.envelope.note_off(_shape);
+        }
+    }
+}
+
+void SpectralNoiseVoices::all_notes_off() {
+    for (auto& voice : _voices) {
+        voice.is_held = false;
+        voice.envelope.note_off(_shape);
+    }
+}
+
+void SpectralNoiseVoices::reset() {
+    for (auto& voice : _voices) {
+        voice.is_held = false;
+        voice.envelope.reset();
+    }
+    _channel_expressions.fill(0.f);
+}
+
+// released notes keep the expression they had, mpe controllers stop sending it with the note off
+void SpectralNoiseVoices::set_channel_expression(int channel, float expression) {
+    if (channel >= 1 && channel <= int(midi_channels_count)) {
+        _channel_expressions[size_t(channel - 1)] = expression;
+    }
+    for (auto& voice : _voices) {
+        if (voice.is_held && voice.channel == channel) {
+            voice.expression = expression;
+        }
+    }
+}
+
+void SpectralNoiseVoices::set_note_expression(int channel, int note, float expression) {
+    for (auto& voice : _voices) {
+        if (voice.is_held && voice.channel == channel && voice.note == note) {
+            voice.expression = expression;
+        }
+    }
+}
+
+bool SpectralNoiseVoices::is_active() const {
+    return std::any_of(_voices.begin(), _voices.end(), [](Voice const& voice) {
+        return voice.envelope.is_active();
+    });
+}
+
+// envelopes are rendered a chunk at a time for every sounding voice, the heads then read them
+// each voice's heads are rendered by the kernel into the sums of the chunk, they are added to the channel after the last voice
+void SpectralNoiseVoices::render(SpectralNoiseColours const& colours, float* const* channels, size_t channels_count, size_t count) {
+    for (size_t channel = 0; channel < channels_count; ++channel) {
+        std::fill(channels[channel], channels[channel] + count, 0.f);
+    }
+    auto const is_playable = _frame_size > 0 && colours.is_allocated() && colours.frame_size() == _frame_size;
+    auto const rendered_channels_count = is_playable ? std::min(channels_count, colours.channels_count()) : 0;
+
+    // each head's level of either colour, and its interpolator's coefficients at phase 0
+    float const* lower_levels[max_unison];
+    float const* upper_levels[max_unison];
+    float const* coefficient_tables[max_unison];
+
+    for (size_t chunk_begin = 0; chunk_begin < count; chunk_begin += chunk_size) {
+        auto const chunk = std::min(chunk_size, count - chunk_begin);
+
+        // voices that finish releasing in this chunk are still read up to their end
+        _chunk_voices.clear();
+        for (size_t voice_index = 0; voice_index < _voices.size(); ++voice_index) {
+            auto& voice = _voices[voice_index];
+            if (voice.envelope.is_active()) {
+                voice.envelope.render(_shape, _envelope_gains.data() + voice_index * chunk_size, chunk);
+                _chunk_voices.push_back(move_colour(voice, voice_index, chunk));
+            }
+        }
+        if (_chunk_voices.empty()) {
+            continue;
+        }
+
+        for (size_t channel = 0; channel < rendered_channels_count; ++channel) {
+            // every channel replays the heads from the same positions, the last one stores where they ended
+            bool const is_last_channel = channel + 1 == rendered_channels_count;
+
+            for (auto const& chunk_voice : _chunk_voices) {
+                auto const voice_index = chunk_voice.voice_index;
+                auto const& voice = _voices[voice_index];
+                auto const first_head = voice_index * max_unison;
+                auto const& lower = colours.tables(chunk_voice.colour);
+                auto const& upper = colours.tables(chunk_voice.colour + 1);
+                for (size_t head = 0; head < voice.heads_count; ++head) {
+                    lower_levels[head] = lower.samples(channel, _head_levels[first_head + head], 0);
+                    upper_levels[head] = upper.samples(channel, _head_levels[first_head + head], 0);
+                    coefficient_tables[head] = lower.coefficients(_head_cutoffs[first_head + head], 0.f);
+                }
+
+                SpectralNoiseHeads::Chunk heads;
+                heads.heads_count = voice.heads_count;
+                heads.count = chunk;
+                heads.indices = _head_indices.data() + first_head;
+                heads.fractions = _head_fractions.data() + first_head;
+                heads.is_storing_positions = is_last_channel;
+                heads.index_steps = _head_index_steps.data() + first_head;
+                heads.fraction_steps = _head_fraction_steps.data() + first_head;
+                heads.level_scales = _head_level_scales.data() + first_head;
+                heads.lower_levels = lower_levels;
+                heads.upper_levels = upper_levels;
+                heads.coefficient_tables = coefficient_tables;
+                heads.frame_size = float(_frame_size);
+                heads.weight = chunk_voice.weight;
+                heads.weight_step = chunk_voice.weight_step;
+                heads.gain = voice.gain;
+                heads.gains = _envelope_gains.data() + voice_index * chunk_size;
+                _kernel->render(heads, _head_sums.data());
+            }
+            _kernel->add_sums(_head_sums.data(), channels[channel] + chunk_begin, chunk);
+        }
+    }
+}
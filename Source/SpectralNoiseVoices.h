@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "SpectralNoiseColours.h"
+#include "SpectralNoiseEnvelope.h"
+#include "SpectralNoiseHeads.h"
+
+// a fixed pool of voices playing one looped noise frame, each at the rate of its note
+// the frame is periodic, so every voice loops it without a seam, and its bins are the harmonics of the note
+// voices are only allocated by prepare, notes never allocate, plan or regenerate
+// a voice is a stack of detuned unison heads, kept as structure of arrays and rendered by SpectralNoiseHeads
+// heads read the table level their rate allows, through the polyphase interpolator
+// each voice has its own tilt, the heads read the two colours around it and crossfade them
+// a voice is free once its envelope has finished releasing
+class SpectralNoiseVoices
+{
+	struct Voice
+	{
+		// notes are told apart by channel too, mpe controllers play each note on its own
+		int channel;
+		int note;
+		bool is_held;
+		size_t heads_count;
+		// the heads are uncorrelated, at this gain their powers add up to the envelope's
+		float gain;
+		// order the voice was started in, released voices are stolen before held ones, the oldest first
+		uint64_t start_index;
+		SpectralNoiseEnvelope envelope;
+		// pressure or slide of the note, from 0 to 1, it adds to the tilt
+		float expression;
+		// position between the colours the heads last read, it moves to the voice's tilt a chunk at a time
+		float colour;
+	};
+
+	// the colours a voice reads in a chunk, and its weight of the upper one at the start of the chunk and per sample
+	struct ChunkVoice
+	{
+		size_t voice_index;
+		size_t colour;
+		float weight;
+		float weight_step;
+	};
+
+public:
+	// the frame is about one period of midi note 0, the lowest note reads it at about one sample per sample
+	static constexpr double lowest_frequency = 8.175798915643707;
+	static constexpr size_t max_unison = 16;
+	// envelopes are rendered for this many samples at a time, before the heads read them
+	static constexpr size_t chunk_size = 256;
+	static constexpr size_t midi_channels_count = 16;
+
+private:
+	std::vector<Voice> _voices;
+	SpectralNoiseEnvelope::Shape _shape;
+	// chunk_size gains for each voice, and the voices sounding in the chunk
+	std::vector<float> _envelope_gains;
+	std::vector<ChunkVoice> _chunk_voices;
+	size_t _frame_size;
+	// pitch of the frame played at one sample per sample
+	double _frame_frequency;
+	uint64_t _notes_started;
+	size_t _unison;
+	float _detune_cents;
+	float _db_per_octave;
+	float _expression_db_per_octave;
+	// last expression of each midi channel, mpe controllers send it before the note on, new notes start from it
+	std::array<float, midi_channels_count> _channel_expressions;
+
+	// max_unison heads per voice, heads past a voice's heads_count are silent and never rendered
+	// positions are split into a whole sample index and a fraction, both exact as floats for any frame size we use
+	std::vector<float> _head_indices;
+	std::vector<float> _head_fractions;
+	std::vector<float> _head_index_steps;
+	std::vector<float> _head_fraction_steps;
+	// table level and interpolator cutoff of each head, and the factor from positions in the frame to positions in the level
+	std::vector<size_t> _head_levels;
+	std::vector<size_t> _head_cutoffs;
+	std::vector<float> _head_level_scales;
+	SpectralNoiseHeads::Kernel const* _kernel;
+	// the heads of every voice in a chunk of one channel, max_lanes per sample
+	std::vector<float> _head_sums;
+
+	void set_head_rates(Voice const& voice, size_t voice_index);
+	float target_colour(Voice const& voice) const;
+	ChunkVoice move_colour(Voice& voice, size_t voice_index, size_t count) const;
+
+public:
+	SpectralNoiseVoices();
+	// positions are in samples of the frame, the frame size only changes with the pool
+	void prepare(size_t voices_count, size_t frame_size, double sample_rate);
+	static double frame_duration();
+	// heads are spread evenly over plus and minus the detune
+	// the detune applies to held notes right away, the unison to the next notes
+	void set_unison(size_t unison, float detune_cents);
+	void set_envelope(SpectralNoiseEnvelope::Shape const& shape);
+	// the tilt of a voice is the shared one, plus its expression times the expression tilt
+	void set_tilt(float db_per_octave, float expression_db_per_octave);
+	void note_on(int channel, int note, float velocity);
+	void note_off(int channel, int note);
+	void all_notes_off();
+	// silences every voice at once, without a release, and forgets the channels' expression
+	void reset();
+	// the expression of every held note of a channel, kept for its next notes, or of one note
+	void set_channel_expression(int channel, float expression);
+	void set_note_expression(int channel, int note, float expression);
+	bool is_active() const;
+	// every output channel reads its own channel of the colours, channels past theirs are cleared
+	void render(SpectralNoiseColours const& colours, float* const* channels, size_t channels_count, size_t count);
+};
@@ -0,0 +1,63 @@
+#include "SpectralNoiseWorker.h"
+#include <chrono>
+#include <utility>
+#include "SpectralNoisePlanner.h"
+
+SpectralNoiseWorker::SpectralNoiseWorker():
+	_should_stop(false)
+{}
+
+SpectralNoiseWorker::~SpectralNoiseWorker() {
+    stop();
+}
+
+void SpectralNoiseWorker::start(std::vector<SpectralNoiseSampler*> samplers, std::vector<SpectralNoiseTransform*> transforms, std::vector<SpectralNoiseColours*> colours) {
+    stop();
+    _samplers = std::move(samplers);
+    _transforms = std::move(transforms);
+    _colours = std::move(colours);
+    _should_stop = false;
+    _thread = std::thread(&SpectralNoiseWorker::run, this);
+}
+
+void SpectralNoiseWorker::stop() {
+    if (!_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _should_stop = true;
+    }
+    _condition.notify_one();
+    _thread.join();
+}
+
+void SpectralNoiseWorker::run() {
+    // the audio thread never signals us, polling keeps it free of locks and system calls
+    auto const poll_interval = std::chrono::milliseconds(5);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_should_stop) {
+        lock.unlock();
+        for (auto* colours : _colours) {
+            if (colours->is_allocation_wanted()) {
+                colours->allocate();
+            }
+        }
+        for (auto* transform : _transforms) {
+            if (transform->is_plan_wanted()) {
+                transform->request_plan();
+            }
+        }
+        for (auto* sampler : _samplers) {
+            sampler->prepare_next_buffer();
+        }
+        // the planning thread measures the sizes planned without wisdom, rather than prepareToPlay
+        for (auto* transform : _transforms) {
+            transform->upgrade_plan();
+        }
+        lock.lock();
+        _condition.wait_for(lock, poll_interval, [this] { return _should_stop; });
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "SpectralNoiseSampler.h"
+#include "SpectralNoiseTransform.h"
+#include "SpectralNoiseColours.h"
+
+// renders the next buffer of background samplers ahead of time, off the audio thread
+// allocates the colours once the voices ask for them
+// also requests the plans the engines' transforms ask for, and upgrades them once the planning thread has measured their sizes
+class SpectralNoiseWorker
+{
+	std::vector<SpectralNoiseSampler*> _samplers;
+	std::vector<SpectralNoiseTransform*> _transforms;
+	std::vector<SpectralNoiseColours*> _colours;
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	bool _should_stop;
+
+	void run();
+
+public:
+	SpectralNoiseWorker();
+	~SpectralNoiseWorker();
+	void start(std::vector<SpectralNoiseSampler*> samplers, std::vector<SpectralNoiseTransform*> transforms, std::vector<SpectralNoiseColours*> colours);
+	void stop();
+};